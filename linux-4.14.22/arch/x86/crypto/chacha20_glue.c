@@ -101,6 +101,28 @@ static int chacha20_simd(struct skcipher_request *req)
 	return err;
 }
 
+/* Keystream generator for the CRNG, see chacha20_blocks(). */
+static unsigned int chacha20_blocks_simd(u32 *state, u8 *stream,
+					 unsigned int nblocks)
+{
+	u32 *st, st_buf[16 + 2] __aligned(8);
+
+	if (nblocks < 4 || !may_use_simd())
+		return 0;
+
+	st = PTR_ALIGN(st_buf + 0, CHACHA20_STATE_ALIGN);
+	memcpy(st, state, 16 * sizeof(u32));
+	memset(stream, 0, nblocks * CHACHA20_BLOCK_SIZE);
+
+	kernel_fpu_begin();
+	chacha20_dosimd(st, stream, stream, nblocks * CHACHA20_BLOCK_SIZE);
+	kernel_fpu_end();
+
+	memcpy(state, st, 16 * sizeof(u32));
+	memzero_explicit(st_buf, sizeof(st_buf));
+	return nblocks;
+}
+
 static struct skcipher_alg alg = {
 	.base.cra_name		= "chacha20",
 	.base.cra_driver_name	= "chacha20-simd",
@@ -121,6 +143,8 @@ static struct skcipher_alg alg = {
 
 static int __init chacha20_simd_mod_init(void)
 {
+	int err;
+
 	if (!boot_cpu_has(X86_FEATURE_SSSE3))
 		return -ENODEV;
 
@@ -129,11 +153,17 @@ static int __init chacha20_simd_mod_init(void)
 			    boot_cpu_has(X86_FEATURE_AVX2) &&
 			    cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL);
 #endif
-	return crypto_register_skcipher(&alg);
+	err = crypto_register_skcipher(&alg);
+	if (err)
+		return err;
+
+	chacha20_register_blocks(chacha20_blocks_simd);
+	return 0;
 }
 
 static void __exit chacha20_simd_mod_fini(void)
 {
+	chacha20_register_blocks(NULL);
 	crypto_unregister_skcipher(&alg);
 }
 
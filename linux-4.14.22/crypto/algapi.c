@@ -20,11 +20,73 @@
 #include <linux/rtnetlink.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/wait.h>
 
 #include "internal.h"
 
 static LIST_HEAD(crypto_template_list);
 
+#ifdef CONFIG_CRYPTO_MANAGER_ASYNC_TESTS
+static int crypto_test_mode = CRYPTO_TEST_STRICT;
+
+/* Process kernel command-line parameter at boot time. */
+static int __init crypto_selftest_setup(char *str)
+{
+	if (!strcmp(str, "sync"))
+		crypto_test_mode = CRYPTO_TEST_SYNC;
+	else if (!strcmp(str, "strict"))
+		crypto_test_mode = CRYPTO_TEST_STRICT;
+	else if (!strcmp(str, "permissive"))
+		crypto_test_mode = CRYPTO_TEST_PERMISSIVE;
+	else
+		pr_warn("crypto: unknown self-test policy %s\n", str);
+
+	return 1;
+}
+__setup("crypto_selftest=", crypto_selftest_setup);
+
+/*
+ * Only built-in algorithms registered before userspace starts may be
+ * tested in the background.  They can still be unregistered while their
+ * test runs, e.g. on a driver's probe error path, so
+ * crypto_unregister_alg() and crypto_unregister_instance() wait for the
+ * tests started with crypto_alg_test_start() to be done.
+ */
+int crypto_alg_test_mode(struct crypto_alg *alg)
+{
+	if (fips_enabled || alg->cra_module || system_state >= SYSTEM_RUNNING)
+		return CRYPTO_TEST_SYNC;
+
+	return crypto_test_mode;
+}
+EXPORT_SYMBOL_GPL(crypto_alg_test_mode);
+
+static DECLARE_WAIT_QUEUE_HEAD(crypto_test_wait);
+
+void crypto_alg_test_start(struct crypto_alg *alg)
+{
+	atomic_inc(&alg->cra_tests_pending);
+}
+EXPORT_SYMBOL_GPL(crypto_alg_test_start);
+
+void crypto_alg_test_done(struct crypto_alg *alg)
+{
+	/* alg may be freed as soon as the count drops to zero */
+	if (atomic_dec_and_test(&alg->cra_tests_pending))
+		wake_up_all(&crypto_test_wait);
+}
+EXPORT_SYMBOL_GPL(crypto_alg_test_done);
+
+static void crypto_wait_for_tests(struct crypto_alg *alg)
+{
+	wait_event(crypto_test_wait, !atomic_read(&alg->cra_tests_pending));
+}
+#else
+static inline void crypto_wait_for_tests(struct crypto_alg *alg)
+{
+}
+#endif
+
 static inline int crypto_set_driver_name(struct crypto_alg *alg)
 {
 	static const char suffix[] = "-generic";
@@ -205,6 +267,8 @@ static struct crypto_larval *__crypto_register_alg(struct crypto_alg *alg)
 
 	/* No cheating! */
 	alg->cra_flags &= ~CRYPTO_ALG_TESTED;
+	alg->cra_test_nsecs = 0;
+	alg->cra_test_err = 0;
 
 	ret = -EEXIST;
 
@@ -259,6 +323,7 @@ void crypto_alg_tested(const char *name, int err)
 	struct crypto_larval *test;
 	struct crypto_alg *alg;
 	struct crypto_alg *q;
+	bool async = false;
 	LIST_HEAD(list);
 
 	down_write(&crypto_alg_sem);
@@ -277,6 +342,7 @@ void crypto_alg_tested(const char *name, int err)
 
 found:
 	q->cra_flags |= CRYPTO_ALG_DEAD;
+	async = test->test_async;
 	alg = test->adult;
 	if (err || list_empty(&alg->cra_list))
 		goto complete;
@@ -329,10 +395,34 @@ complete:
 unlock:
 	up_write(&crypto_alg_sem);
 
+	/* Nobody is waiting in crypto_wait_for_test() for this larval. */
+	if (async)
+		crypto_larval_kill(&test->alg);
+
 	crypto_remove_final(&list);
 }
 EXPORT_SYMBOL_GPL(crypto_alg_tested);
 
+void crypto_alg_test_stats(const char *name, int err, u64 nsecs)
+{
+	struct crypto_alg *q;
+
+	down_write(&crypto_alg_sem);
+	list_for_each_entry(q, &crypto_alg_list, cra_list) {
+		if (crypto_is_moribund(q) || crypto_is_larval(q))
+			continue;
+
+		if (strcmp(q->cra_driver_name, name))
+			continue;
+
+		q->cra_test_nsecs = nsecs;
+		q->cra_test_err = err;
+		break;
+	}
+	up_write(&crypto_alg_sem);
+}
+EXPORT_SYMBOL_GPL(crypto_alg_test_stats);
+
 void crypto_remove_final(struct list_head *list)
 {
 	struct crypto_alg *alg;
@@ -347,6 +437,7 @@ EXPORT_SYMBOL_GPL(crypto_remove_final);
 
 static void crypto_wait_for_test(struct crypto_larval *larval)
 {
+	bool async = larval->test_async;
 	int err;
 
 	err = crypto_probing_notify(CRYPTO_MSG_ALG_REGISTER, larval->adult);
@@ -356,6 +447,13 @@ static void crypto_wait_for_test(struct crypto_larval *larval)
 		crypto_alg_tested(larval->alg.cra_driver_name, 0);
 	}
 
+	/*
+	 * The larval now belongs to crypto_alg_tested() and may already
+	 * be gone.  Lookups keep blocking on it until the test finishes.
+	 */
+	if (async)
+		return;
+
 	err = wait_for_completion_killable(&larval->completion);
 	WARN_ON(err);
 
@@ -375,6 +473,9 @@ int crypto_register_alg(struct crypto_alg *alg)
 
 	down_write(&crypto_alg_sem);
 	larval = __crypto_register_alg(alg);
+	if (!IS_ERR(larval))
+		larval->test_async =
+			crypto_alg_test_mode(alg) == CRYPTO_TEST_STRICT;
 	up_write(&crypto_alg_sem);
 
 	if (IS_ERR(larval))
@@ -404,6 +505,9 @@ int crypto_unregister_alg(struct crypto_alg *alg)
 	int ret;
 	LIST_HEAD(list);
 
+	/* A background self-test holds a reference to the algorithm */
+	crypto_wait_for_tests(alg);
+
 	down_write(&crypto_alg_sem);
 	ret = crypto_remove_alg(alg, &list);
 	up_write(&crypto_alg_sem);
@@ -584,6 +688,8 @@ int crypto_unregister_instance(struct crypto_instance *inst)
 {
 	LIST_HEAD(list);
 
+	crypto_wait_for_tests(&inst->alg);
+
 	down_write(&crypto_alg_sem);
 
 	crypto_remove_spawns(&inst->alg, &list, NULL);
@@ -16,12 +16,14 @@
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/notifier.h>
 #include <linux/rtnetlink.h>
 #include <linux/sched/signal.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/workqueue.h>
 
 #include "internal.h"
 
@@ -57,8 +59,15 @@ struct crypto_test_param {
 	char driver[CRYPTO_MAX_ALG_NAME];
 	char alg[CRYPTO_MAX_ALG_NAME];
 	u32 type;
+	int mode;
+	struct crypto_alg *adult;
+	struct work_struct work;
 };
 
+#ifdef CONFIG_CRYPTO_MANAGER_ASYNC_TESTS
+static struct workqueue_struct *cryptomgr_test_wq;
+#endif
+
 static int cryptomgr_probe(void *data)
 {
 	struct cryptomgr_param *param = data;
@@ -208,10 +217,10 @@ err:
 	return NOTIFY_OK;
 }
 
-static int cryptomgr_test(void *data)
+static void cryptomgr_run_test(struct crypto_test_param *param)
 {
-	struct crypto_test_param *param = data;
 	u32 type = param->type;
+	ktime_t start;
 	int err = 0;
 
 #ifdef CONFIG_CRYPTO_MANAGER_DISABLE_TESTS
@@ -221,15 +230,50 @@ static int cryptomgr_test(void *data)
 	if (type & CRYPTO_ALG_TESTED)
 		goto skiptest;
 
+	start = ktime_get();
 	err = alg_test(param->driver, param->alg, type, CRYPTO_ALG_TESTED);
+	crypto_alg_test_stats(param->driver, err,
+			      ktime_to_ns(ktime_sub(ktime_get(), start)));
 
 skiptest:
-	crypto_alg_tested(param->driver, err);
+	/*
+	 * Once the larval is completed, the algorithm may be unregistered and
+	 * freed, so let that through first.
+	 */
+	if (param->adult)
+		crypto_alg_test_done(param->adult);
+
+	/* Permissive mode has already marked the algorithm as tested. */
+	if (param->mode != CRYPTO_TEST_PERMISSIVE)
+		crypto_alg_tested(param->driver, err);
+	else if (err)
+		pr_err("alg: self-test for %s (%s) failed: %d\n",
+		       param->driver, param->alg, err);
+}
+
+static int cryptomgr_test(void *data)
+{
+	struct crypto_test_param *param = data;
+
+	cryptomgr_run_test(param);
 
 	kfree(param);
 	module_put_and_exit(0);
 }
 
+#ifdef CONFIG_CRYPTO_MANAGER_ASYNC_TESTS
+static void cryptomgr_test_work(struct work_struct *work)
+{
+	struct crypto_test_param *param =
+		container_of(work, struct crypto_test_param, work);
+
+	cryptomgr_run_test(param);
+
+	kfree(param);
+	module_put(THIS_MODULE);
+}
+#endif
+
 static int cryptomgr_schedule_test(struct crypto_alg *alg)
 {
 	struct task_struct *thread;
@@ -252,6 +296,28 @@ static int cryptomgr_schedule_test(struct crypto_alg *alg)
 		type |= CRYPTO_ALG_TESTED;
 
 	param->type = type;
+	param->mode = crypto_alg_test_mode(alg);
+
+#ifdef CONFIG_CRYPTO_MANAGER_ASYNC_TESTS
+	if (param->mode != CRYPTO_TEST_SYNC && cryptomgr_test_wq) {
+		if (param->mode == CRYPTO_TEST_PERMISSIVE)
+			crypto_alg_tested(param->driver, 0);
+
+		/*
+		 * Keeps crypto_unregister_alg() and
+		 * crypto_unregister_instance() from freeing it under us
+		 */
+		param->adult = alg;
+		crypto_alg_test_start(alg);
+
+		INIT_WORK(&param->work, cryptomgr_test_work);
+		queue_work(cryptomgr_test_wq, &param->work);
+		return NOTIFY_STOP;
+	}
+#endif
+
+	/* Synchronous tests keep their dedicated thread. */
+	param->mode = CRYPTO_TEST_SYNC;
 
 	thread = kthread_run(cryptomgr_test, param, "cryptomgr_test");
 	if (IS_ERR(thread))
@@ -286,6 +352,15 @@ static struct notifier_block cryptomgr_notifier = {
 
 static int __init cryptomgr_init(void)
 {
+#ifdef CONFIG_CRYPTO_MANAGER_ASYNC_TESTS
+	/*
+	 * Failure is not fatal, tests then simply run synchronously.
+	 * Tests may instantiate templates whose own tests land on the
+	 * same queue, so leave max_active at its (large) default.
+	 */
+	cryptomgr_test_wq = alloc_workqueue("cryptomgr_test", WQ_UNBOUND, 0);
+#endif
+
 	return crypto_register_notifier(&cryptomgr_notifier);
 }
 
@@ -293,6 +368,11 @@ static void __exit cryptomgr_exit(void)
 {
 	int err = crypto_unregister_notifier(&cryptomgr_notifier);
 	BUG_ON(err);
+
+#ifdef CONFIG_CRYPTO_MANAGER_ASYNC_TESTS
+	if (cryptomgr_test_wq)
+		destroy_workqueue(cryptomgr_test_wq);
+#endif
 }
 
 subsys_initcall(cryptomgr_init);
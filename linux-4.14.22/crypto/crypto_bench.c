@@ -0,0 +1,934 @@
+/*
+ * Crypto algorithm benchmark interface.
+ *
+ * Unlike tcrypt this stays loaded and is driven through debugfs:
+ *
+ *   echo "type=skcipher alg=xts(aes) sizes=512,4096 depth=8 threads=4" \
+ *	> /sys/kernel/debug/crypto_bench/run
+ *   cat /sys/kernel/debug/crypto_bench/results
+ *
+ * Every thread owns its own transform and keeps up to depth requests in
+ * flight.  Ciphers are benchmarked in the encrypt direction, compression
+ * algorithms in the compress direction.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <crypto/acompress.h>
+#include <crypto/aead.h>
+#include <crypto/hash.h>
+#include <crypto/skcipher.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/parser.h>
+#include <linux/random.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/timex.h>
+#include <linux/uaccess.h>
+
+#define CBENCH_MAX_SIZES	16
+#define CBENCH_MAX_BLOCK	65536
+#define CBENCH_MAX_DEPTH	64
+#define CBENCH_MAX_THREADS	64
+#define CBENCH_MAX_KEY		64
+#define CBENCH_MAX_IV		32
+#define CBENCH_MAX_DIGEST	64
+#define CBENCH_TAG_ROOM		64
+
+/*
+ * Latency histogram: exact below 16ns, then eight linear sub-buckets per
+ * power of two.  That bounds the percentile error to 12.5%.
+ */
+#define CBENCH_HIST_SUB		8
+#define CBENCH_HIST_BUCKETS	(16 + (64 - 4) * CBENCH_HIST_SUB)
+
+enum cbench_type {
+	CBENCH_SKCIPHER,
+	CBENCH_AEAD,
+	CBENCH_AHASH,
+	CBENCH_SHASH,
+	CBENCH_ACOMP,
+};
+
+static const char * const cbench_type_names[] = {
+	[CBENCH_SKCIPHER]	= "skcipher",
+	[CBENCH_AEAD]		= "aead",
+	[CBENCH_AHASH]		= "ahash",
+	[CBENCH_SHASH]		= "shash",
+	[CBENCH_ACOMP]		= "acomp",
+};
+
+struct cbench_params {
+	enum cbench_type type;
+	char alg[CRYPTO_MAX_ALG_NAME];
+	char driver[CRYPTO_MAX_ALG_NAME];
+	unsigned int sizes[CBENCH_MAX_SIZES];
+	unsigned int nsizes;
+	unsigned int depth;
+	unsigned int threads;
+	unsigned int msecs;
+	unsigned int keylen;
+	bool async;
+};
+
+struct cbench_result {
+	unsigned int size;
+	int err;
+	u64 ops;
+	u64 bytes;
+	u64 nsecs;
+	u64 cycles;
+	u64 p50;
+	u64 p90;
+	u64 p99;
+};
+
+struct cbench_thread;
+
+struct cbench_req {
+	struct cbench_thread *thread;
+	union {
+		struct skcipher_request *skcipher;
+		struct aead_request *aead;
+		struct ahash_request *ahash;
+		struct shash_desc *shash;
+		struct acomp_req *acomp;
+	};
+	struct scatterlist src;
+	struct scatterlist dst;
+	void *sbuf;
+	void *dbuf;
+	u8 iv[CBENCH_MAX_IV];
+	u8 digest[CBENCH_MAX_DIGEST];
+	ktime_t start;
+	ktime_t end;
+	int err;
+};
+
+struct cbench_run;
+
+struct cbench_thread {
+	struct cbench_run *run;
+	union {
+		void *tfm;
+		struct crypto_skcipher *skcipher;
+		struct crypto_aead *aead;
+		struct crypto_ahash *ahash;
+		struct crypto_shash *shash;
+		struct crypto_acomp *acomp;
+	};
+	struct cbench_req *reqs;
+	atomic_t pending;
+	struct completion batch_done;
+	struct completion done;
+	u64 ops;
+	u64 cycles;
+	int err;
+	u32 hist[CBENCH_HIST_BUCKETS];
+};
+
+struct cbench_run {
+	const struct cbench_params *params;
+	unsigned int size;
+	unsigned int order;
+	struct completion start;
+	bool abort;
+	struct cbench_thread *threads;
+};
+
+static struct dentry *cbench_dir;
+
+/*
+ * Serialises runs, which can take minutes, and protects the results of
+ * the run in progress.
+ */
+static DEFINE_MUTEX(cbench_run_mutex);
+static char cbench_run_driver[CRYPTO_MAX_ALG_NAME];
+static struct cbench_result cbench_run_results[CBENCH_MAX_SIZES];
+
+/*
+ * Results of the last completed run, protected by cbench_mutex, which is
+ * only held to publish or show them.
+ */
+static DEFINE_MUTEX(cbench_mutex);
+static struct cbench_params cbench_last;
+static char cbench_last_driver[CRYPTO_MAX_ALG_NAME];
+static struct cbench_result cbench_results[CBENCH_MAX_SIZES];
+static int cbench_last_err = -ENODATA;
+
+static unsigned int cbench_bucket(u64 ns)
+{
+	unsigned int msb;
+
+	if (ns < 16)
+		return ns;
+
+	msb = fls64(ns) - 1;
+	return 16 + (msb - 4) * CBENCH_HIST_SUB +
+	       ((ns >> (msb - 3)) & (CBENCH_HIST_SUB - 1));
+}
+
+static u64 cbench_bucket_value(unsigned int idx)
+{
+	unsigned int msb;
+
+	if (idx < 16)
+		return idx;
+
+	idx -= 16;
+	msb = idx / CBENCH_HIST_SUB + 4;
+	return (u64)(CBENCH_HIST_SUB + idx % CBENCH_HIST_SUB) << (msb - 3);
+}
+
+static u64 cbench_percentile(const u32 *hist, u64 total, unsigned int pct)
+{
+	u64 want = div_u64(total * pct + 99, 100);
+	u64 seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < CBENCH_HIST_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen && seen >= want)
+			return cbench_bucket_value(i);
+	}
+
+	return 0;
+}
+
+static void cbench_req_done(struct cbench_req *r, int err)
+{
+	struct cbench_thread *t = r->thread;
+
+	r->end = ktime_get();
+	r->err = err;
+
+	if (atomic_dec_and_test(&t->pending))
+		complete(&t->batch_done);
+}
+
+static void cbench_complete(struct crypto_async_request *areq, int err)
+{
+	/* Backlogged request has just been started. */
+	if (err == -EINPROGRESS)
+		return;
+
+	cbench_req_done(areq->data, err);
+}
+
+static int cbench_submit(struct cbench_thread *t, struct cbench_req *r)
+{
+	unsigned int size = t->run->size;
+
+	switch (t->run->params->type) {
+	case CBENCH_SKCIPHER:
+		return crypto_skcipher_encrypt(r->skcipher);
+	case CBENCH_AEAD:
+		return crypto_aead_encrypt(r->aead);
+	case CBENCH_AHASH:
+		return crypto_ahash_digest(r->ahash);
+	case CBENCH_SHASH:
+		return crypto_shash_digest(r->shash, r->sbuf, size, r->digest);
+	case CBENCH_ACOMP:
+		/* dlen is overwritten with the produced length. */
+		acomp_request_set_params(r->acomp, &r->src, &r->dst, size,
+					 PAGE_SIZE << t->run->order);
+		return crypto_acomp_compress(r->acomp);
+	}
+
+	return -EINVAL;
+}
+
+/* Submit one batch of depth requests and wait for all of them. */
+static int cbench_batch(struct cbench_thread *t)
+{
+	unsigned int depth = t->run->params->depth;
+	unsigned int i;
+	int err;
+
+	reinit_completion(&t->batch_done);
+	atomic_set(&t->pending, 1);
+
+	for (i = 0; i < depth; i++) {
+		struct cbench_req *r = &t->reqs[i];
+
+		atomic_inc(&t->pending);
+		r->start = ktime_get();
+		err = cbench_submit(t, r);
+		if (err != -EINPROGRESS && err != -EBUSY)
+			cbench_req_done(r, err);
+	}
+
+	if (!atomic_dec_and_test(&t->pending))
+		wait_for_completion(&t->batch_done);
+
+	for (i = 0; i < depth; i++) {
+		struct cbench_req *r = &t->reqs[i];
+
+		if (r->err)
+			return r->err;
+
+		t->hist[cbench_bucket(ktime_to_ns(ktime_sub(r->end,
+							    r->start)))]++;
+	}
+
+	t->ops += depth;
+	return 0;
+}
+
+static int cbench_thread_fn(void *data)
+{
+	struct cbench_thread *t = data;
+	struct cbench_run *run = t->run;
+	ktime_t deadline;
+	cycles_t start;
+
+	wait_for_completion(&run->start);
+	if (READ_ONCE(run->abort))
+		goto out;
+
+	deadline = ktime_add_ms(ktime_get(), run->params->msecs);
+	start = get_cycles();
+
+	do {
+		t->err = cbench_batch(t);
+		cond_resched();
+	} while (!t->err && ktime_before(ktime_get(), deadline));
+
+	t->cycles = get_cycles() - start;
+
+out:
+	complete_and_exit(&t->done, 0);
+}
+
+static struct crypto_tfm *cbench_tfm(struct cbench_thread *t)
+{
+	switch (t->run->params->type) {
+	case CBENCH_SKCIPHER:
+		return crypto_skcipher_tfm(t->skcipher);
+	case CBENCH_AEAD:
+		return crypto_aead_tfm(t->aead);
+	case CBENCH_AHASH:
+		return crypto_ahash_tfm(t->ahash);
+	case CBENCH_SHASH:
+		return crypto_shash_tfm(t->shash);
+	case CBENCH_ACOMP:
+		return crypto_acomp_tfm(t->acomp);
+	}
+
+	return NULL;
+}
+
+static int cbench_alloc_tfm(struct cbench_thread *t)
+{
+	const struct cbench_params *p = t->run->params;
+	const char *name = p->driver[0] ? p->driver : p->alg;
+	u32 mask = p->async ? 0 : CRYPTO_ALG_ASYNC;
+	u8 key[CBENCH_MAX_KEY];
+	unsigned int keylen = p->keylen;
+	int err = 0;
+
+	switch (p->type) {
+	case CBENCH_SKCIPHER:
+		t->skcipher = crypto_alloc_skcipher(name, 0, mask);
+		if (IS_ERR(t->skcipher))
+			return PTR_ERR(t->skcipher);
+		if (!keylen)
+			keylen = t->skcipher->keysize;
+		break;
+	case CBENCH_AEAD:
+		t->aead = crypto_alloc_aead(name, 0, mask);
+		if (IS_ERR(t->aead))
+			return PTR_ERR(t->aead);
+		if (!keylen)
+			keylen = 16;
+		break;
+	case CBENCH_AHASH:
+		t->ahash = crypto_alloc_ahash(name, 0, mask);
+		if (IS_ERR(t->ahash))
+			return PTR_ERR(t->ahash);
+		break;
+	case CBENCH_SHASH:
+		t->shash = crypto_alloc_shash(name, 0, 0);
+		if (IS_ERR(t->shash))
+			return PTR_ERR(t->shash);
+		break;
+	case CBENCH_ACOMP:
+		t->acomp = crypto_alloc_acomp(name, 0, mask);
+		if (IS_ERR(t->acomp))
+			return PTR_ERR(t->acomp);
+		break;
+	}
+
+	if (p->driver[0] && p->alg[0] &&
+	    strcmp(crypto_tfm_alg_name(cbench_tfm(t)), p->alg))
+		return -EINVAL;
+
+	if (keylen > sizeof(key))
+		return -EINVAL;
+
+	get_random_bytes(key, keylen);
+
+	switch (p->type) {
+	case CBENCH_SKCIPHER:
+		err = crypto_skcipher_setkey(t->skcipher, key, keylen);
+		break;
+	case CBENCH_AEAD:
+		err = crypto_aead_setkey(t->aead, key, keylen);
+		break;
+	case CBENCH_AHASH:
+		if (keylen)
+			err = crypto_ahash_setkey(t->ahash, key, keylen);
+		if (crypto_ahash_digestsize(t->ahash) > CBENCH_MAX_DIGEST)
+			err = -EINVAL;
+		break;
+	case CBENCH_SHASH:
+		if (keylen)
+			err = crypto_shash_setkey(t->shash, key, keylen);
+		if (crypto_shash_digestsize(t->shash) > CBENCH_MAX_DIGEST)
+			err = -EINVAL;
+		break;
+	case CBENCH_ACOMP:
+		break;
+	}
+
+	memzero_explicit(key, sizeof(key));
+	return err;
+}
+
+static void cbench_free_tfm(struct cbench_thread *t)
+{
+	if (IS_ERR_OR_NULL(t->tfm))
+		return;
+
+	switch (t->run->params->type) {
+	case CBENCH_SKCIPHER:
+		crypto_free_skcipher(t->skcipher);
+		break;
+	case CBENCH_AEAD:
+		crypto_free_aead(t->aead);
+		break;
+	case CBENCH_AHASH:
+		crypto_free_ahash(t->ahash);
+		break;
+	case CBENCH_SHASH:
+		crypto_free_shash(t->shash);
+		break;
+	case CBENCH_ACOMP:
+		crypto_free_acomp(t->acomp);
+		break;
+	}
+}
+
+static void cbench_free_req(struct cbench_thread *t, struct cbench_req *r)
+{
+	unsigned int order = t->run->order;
+
+	switch (t->run->params->type) {
+	case CBENCH_SKCIPHER:
+		skcipher_request_free(r->skcipher);
+		break;
+	case CBENCH_AEAD:
+		aead_request_free(r->aead);
+		break;
+	case CBENCH_AHASH:
+		ahash_request_free(r->ahash);
+		break;
+	case CBENCH_SHASH:
+		kzfree(r->shash);
+		break;
+	case CBENCH_ACOMP:
+		if (r->acomp)
+			acomp_request_free(r->acomp);
+		break;
+	}
+
+	if (r->dbuf)
+		free_pages((unsigned long)r->dbuf, order);
+	if (r->sbuf)
+		free_pages((unsigned long)r->sbuf, order);
+}
+
+static int cbench_init_req(struct cbench_thread *t, struct cbench_req *r)
+{
+	const struct cbench_params *p = t->run->params;
+	unsigned int order = t->run->order;
+	unsigned int size = t->run->size;
+	u32 flags = CRYPTO_TFM_REQ_MAY_BACKLOG;
+	unsigned int i;
+
+	r->thread = t;
+
+	r->sbuf = (void *)__get_free_pages(GFP_KERNEL, order);
+	if (!r->sbuf)
+		return -ENOMEM;
+
+	/* Mildly compressible data, not that ciphers would care. */
+	for (i = 0; i < (PAGE_SIZE << order); i++)
+		((u8 *)r->sbuf)[i] = 'a' + (i / 16) % 26;
+
+	get_random_bytes(r->iv, sizeof(r->iv));
+
+	switch (p->type) {
+	case CBENCH_SKCIPHER:
+		if (crypto_skcipher_ivsize(t->skcipher) > CBENCH_MAX_IV)
+			return -EINVAL;
+		r->skcipher = skcipher_request_alloc(t->skcipher, GFP_KERNEL);
+		if (!r->skcipher)
+			return -ENOMEM;
+		sg_init_one(&r->src, r->sbuf, size);
+		skcipher_request_set_callback(r->skcipher, flags,
+					      cbench_complete, r);
+		skcipher_request_set_crypt(r->skcipher, &r->src, &r->src, size,
+					   r->iv);
+		break;
+	case CBENCH_AEAD:
+		if (crypto_aead_ivsize(t->aead) > CBENCH_MAX_IV ||
+		    crypto_aead_authsize(t->aead) > CBENCH_TAG_ROOM)
+			return -EINVAL;
+		r->aead = aead_request_alloc(t->aead, GFP_KERNEL);
+		if (!r->aead)
+			return -ENOMEM;
+		sg_init_one(&r->src, r->sbuf,
+			    size + crypto_aead_authsize(t->aead));
+		aead_request_set_callback(r->aead, flags, cbench_complete, r);
+		aead_request_set_crypt(r->aead, &r->src, &r->src, size, r->iv);
+		aead_request_set_ad(r->aead, 0);
+		break;
+	case CBENCH_AHASH:
+		r->ahash = ahash_request_alloc(t->ahash, GFP_KERNEL);
+		if (!r->ahash)
+			return -ENOMEM;
+		sg_init_one(&r->src, r->sbuf, size);
+		ahash_request_set_callback(r->ahash, flags, cbench_complete, r);
+		ahash_request_set_crypt(r->ahash, &r->src, r->digest, size);
+		break;
+	case CBENCH_SHASH:
+		r->shash = kzalloc(sizeof(*r->shash) +
+				   crypto_shash_descsize(t->shash), GFP_KERNEL);
+		if (!r->shash)
+			return -ENOMEM;
+		r->shash->tfm = t->shash;
+		break;
+	case CBENCH_ACOMP:
+		r->dbuf = (void *)__get_free_pages(GFP_KERNEL, order);
+		if (!r->dbuf)
+			return -ENOMEM;
+		r->acomp = acomp_request_alloc(t->acomp);
+		if (!r->acomp)
+			return -ENOMEM;
+		sg_init_one(&r->src, r->sbuf, size);
+		sg_init_one(&r->dst, r->dbuf, PAGE_SIZE << order);
+		acomp_request_set_callback(r->acomp, flags, cbench_complete, r);
+		break;
+	}
+
+	return 0;
+}
+
+static void cbench_free_thread(struct cbench_thread *t)
+{
+	unsigned int i;
+
+	if (t->reqs) {
+		for (i = 0; i < t->run->params->depth; i++)
+			cbench_free_req(t, &t->reqs[i]);
+		kfree(t->reqs);
+	}
+
+	cbench_free_tfm(t);
+}
+
+static int cbench_init_thread(struct cbench_thread *t)
+{
+	unsigned int depth = t->run->params->depth;
+	unsigned int i;
+	int err;
+
+	init_completion(&t->batch_done);
+	init_completion(&t->done);
+
+	err = cbench_alloc_tfm(t);
+	if (err)
+		return err;
+
+	t->reqs = kcalloc(depth, sizeof(*t->reqs), GFP_KERNEL);
+	if (!t->reqs)
+		return -ENOMEM;
+
+	for (i = 0; i < depth; i++) {
+		err = cbench_init_req(t, &t->reqs[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static int cbench_run_size(const struct cbench_params *p, unsigned int size,
+			   struct cbench_result *res)
+{
+	struct cbench_run run = {
+		.params = p,
+		.size = size,
+		/* Room for an AEAD tag or incompressible output. */
+		.order = get_order(size + CBENCH_TAG_ROOM),
+	};
+	unsigned int started = 0;
+	unsigned int i, j;
+	ktime_t start;
+	u32 *hist;
+	int err = 0;
+
+	memset(res, 0, sizeof(*res));
+	res->size = size;
+
+	hist = kcalloc(CBENCH_HIST_BUCKETS, sizeof(*hist), GFP_KERNEL);
+	run.threads = kcalloc(p->threads, sizeof(*run.threads), GFP_KERNEL);
+	if (!hist || !run.threads) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	init_completion(&run.start);
+
+	for (i = 0; i < p->threads; i++) {
+		run.threads[i].run = &run;
+		err = cbench_init_thread(&run.threads[i]);
+		if (err)
+			goto out_threads;
+	}
+
+	if (!cbench_run_driver[0])
+		strlcpy(cbench_run_driver,
+			crypto_tfm_alg_driver_name(cbench_tfm(&run.threads[0])),
+			sizeof(cbench_run_driver));
+
+	for (; started < p->threads; started++) {
+		struct task_struct *task;
+
+		task = kthread_run(cbench_thread_fn, &run.threads[started],
+				   "cbench/%u", started);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			run.abort = true;
+			break;
+		}
+	}
+
+	start = ktime_get();
+	complete_all(&run.start);
+
+	for (i = 0; i < started; i++)
+		wait_for_completion(&run.threads[i].done);
+
+	res->nsecs = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < started && !err; i++) {
+		struct cbench_thread *t = &run.threads[i];
+
+		if (t->err)
+			err = t->err;
+
+		res->ops += t->ops;
+		res->cycles += t->cycles;
+		for (j = 0; j < CBENCH_HIST_BUCKETS; j++)
+			hist[j] += t->hist[j];
+	}
+
+	res->bytes = res->ops * size;
+	res->p50 = cbench_percentile(hist, res->ops, 50);
+	res->p90 = cbench_percentile(hist, res->ops, 90);
+	res->p99 = cbench_percentile(hist, res->ops, 99);
+
+out_threads:
+	for (i = 0; i < p->threads; i++)
+		if (run.threads[i].run)
+			cbench_free_thread(&run.threads[i]);
+out:
+	kfree(run.threads);
+	kfree(hist);
+	res->err = err;
+	return err;
+}
+
+enum {
+	Opt_type, Opt_alg, Opt_driver, Opt_sizes, Opt_depth, Opt_threads,
+	Opt_msecs, Opt_keylen, Opt_sync, Opt_async, Opt_err,
+};
+
+static const match_table_t cbench_tokens = {
+	{ Opt_type, "type=%s" },
+	{ Opt_alg, "alg=%s" },
+	{ Opt_driver, "driver=%s" },
+	{ Opt_sizes, "sizes=%s" },
+	{ Opt_depth, "depth=%u" },
+	{ Opt_threads, "threads=%u" },
+	{ Opt_msecs, "msecs=%u" },
+	{ Opt_keylen, "keylen=%u" },
+	{ Opt_sync, "sync" },
+	{ Opt_async, "async" },
+	{ Opt_err, NULL },
+};
+
+static int cbench_parse_sizes(struct cbench_params *p, char *list)
+{
+	char *s;
+
+	p->nsizes = 0;
+	while ((s = strsep(&list, ",")) != NULL) {
+		unsigned int size;
+
+		if (!*s)
+			continue;
+		if (p->nsizes == CBENCH_MAX_SIZES || kstrtouint(s, 0, &size) ||
+		    !size || size > CBENCH_MAX_BLOCK)
+			return -EINVAL;
+		p->sizes[p->nsizes++] = size;
+	}
+
+	return p->nsizes ? 0 : -EINVAL;
+}
+
+static int cbench_parse(struct cbench_params *p, char *buf)
+{
+	static const unsigned int default_sizes[] = {
+		16, 64, 256, 1024, 4096,
+	};
+	substring_t args[MAX_OPT_ARGS];
+	bool have_type = false;
+	char *opt, *str;
+	int err, i;
+
+	memset(p, 0, sizeof(*p));
+	memcpy(p->sizes, default_sizes, sizeof(default_sizes));
+	p->nsizes = ARRAY_SIZE(default_sizes);
+	p->depth = 1;
+	p->threads = 1;
+	p->msecs = 1000;
+	p->async = true;
+
+	while ((opt = strsep(&buf, " \t\n")) != NULL) {
+		if (!*opt)
+			continue;
+
+		switch (match_token(opt, cbench_tokens, args)) {
+		case Opt_type:
+			str = match_strdup(&args[0]);
+			if (!str)
+				return -ENOMEM;
+			i = match_string(cbench_type_names,
+					 ARRAY_SIZE(cbench_type_names), str);
+			kfree(str);
+			if (i < 0)
+				return -EINVAL;
+			p->type = i;
+			have_type = true;
+			break;
+		case Opt_alg:
+			if (match_strlcpy(p->alg, &args[0], sizeof(p->alg)) >=
+			    sizeof(p->alg))
+				return -ENAMETOOLONG;
+			break;
+		case Opt_driver:
+			if (match_strlcpy(p->driver, &args[0],
+					  sizeof(p->driver)) >= sizeof(p->driver))
+				return -ENAMETOOLONG;
+			break;
+		case Opt_sizes:
+			str = match_strdup(&args[0]);
+			if (!str)
+				return -ENOMEM;
+			err = cbench_parse_sizes(p, str);
+			kfree(str);
+			if (err)
+				return err;
+			break;
+		case Opt_depth:
+			if (match_int(&args[0], &i) || i < 1 ||
+			    i > CBENCH_MAX_DEPTH)
+				return -EINVAL;
+			p->depth = i;
+			break;
+		case Opt_threads:
+			if (match_int(&args[0], &i) || i < 1 ||
+			    i > CBENCH_MAX_THREADS)
+				return -EINVAL;
+			p->threads = i;
+			break;
+		case Opt_msecs:
+			if (match_int(&args[0], &i) || i < 1 || i > 60000)
+				return -EINVAL;
+			p->msecs = i;
+			break;
+		case Opt_keylen:
+			if (match_int(&args[0], &i) || i < 0 ||
+			    i > CBENCH_MAX_KEY)
+				return -EINVAL;
+			p->keylen = i;
+			break;
+		case Opt_sync:
+			p->async = false;
+			break;
+		case Opt_async:
+			p->async = true;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	if (!have_type || (!p->alg[0] && !p->driver[0]))
+		return -EINVAL;
+
+	return 0;
+}
+
+static ssize_t cbench_run_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	struct cbench_params p;
+	unsigned int i;
+	char *buf;
+	int err;
+
+	if (count >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = memdup_user_nul(ubuf, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	err = cbench_parse(&p, buf);
+	kfree(buf);
+	if (err)
+		return err;
+
+	if (mutex_lock_interruptible(&cbench_run_mutex))
+		return -EINTR;
+
+	cbench_run_driver[0] = '\0';
+	memset(cbench_run_results, 0, sizeof(cbench_run_results));
+
+	for (i = 0; i < p.nsizes; i++) {
+		err = cbench_run_size(&p, p.sizes[i], &cbench_run_results[i]);
+		if (err)
+			break;
+	}
+
+	/* Readers of the results only wait for the copy */
+	mutex_lock(&cbench_mutex);
+	cbench_last = p;
+	memcpy(cbench_last_driver, cbench_run_driver,
+	       sizeof(cbench_last_driver));
+	memcpy(cbench_results, cbench_run_results, sizeof(cbench_results));
+	cbench_last_err = err;
+	mutex_unlock(&cbench_mutex);
+
+	mutex_unlock(&cbench_run_mutex);
+
+	return err ?: count;
+}
+
+static const struct file_operations cbench_run_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.write		= cbench_run_write,
+	.llseek		= noop_llseek,
+};
+
+static int cbench_results_show(struct seq_file *m, void *v)
+{
+	const struct cbench_params *p = &cbench_last;
+	unsigned int i;
+
+	mutex_lock(&cbench_mutex);
+
+	if (cbench_last_err == -ENODATA)
+		goto out;
+
+	seq_printf(m, "type     : %s\n", cbench_type_names[p->type]);
+	seq_printf(m, "alg      : %s\n", p->alg[0] ? p->alg : "-");
+	seq_printf(m, "driver   : %s\n",
+		   cbench_last_driver[0] ? cbench_last_driver : "-");
+	seq_printf(m, "mode     : %s\n", p->async ? "async" : "sync");
+	seq_printf(m, "threads  : %u\n", p->threads);
+	seq_printf(m, "depth    : %u\n", p->depth);
+	seq_printf(m, "msecs    : %u\n", p->msecs);
+	seq_printf(m, "status   : %d\n", cbench_last_err);
+	seq_puts(m, "# size ops/s MB/s cycles/byte p50_ns p90_ns p99_ns\n");
+
+	for (i = 0; i < p->nsizes; i++) {
+		const struct cbench_result *r = &cbench_results[i];
+		u64 ops_sec, cpb100;
+
+		if (!r->nsecs || r->err)
+			break;
+
+		ops_sec = div64_u64(r->ops * NSEC_PER_SEC, r->nsecs);
+		cpb100 = r->bytes ? div64_u64(r->cycles * 100, r->bytes) : 0;
+
+		seq_printf(m, "%u %llu %llu %llu.%02llu %llu %llu %llu\n",
+			   r->size, ops_sec,
+			   div64_u64(r->bytes * 1000, r->nsecs),
+			   div_u64(cpb100, 100), cpb100 % 100,
+			   r->p50, r->p90, r->p99);
+	}
+
+out:
+	mutex_unlock(&cbench_mutex);
+	return 0;
+}
+
+static int cbench_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cbench_results_show, NULL);
+}
+
+static const struct file_operations cbench_results_fops = {
+	.owner		= THIS_MODULE,
+	.open		= cbench_results_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init crypto_bench_init(void)
+{
+	cbench_dir = debugfs_create_dir("crypto_bench", NULL);
+	if (IS_ERR_OR_NULL(cbench_dir))
+		return cbench_dir ? PTR_ERR(cbench_dir) : -ENOMEM;
+
+	debugfs_create_file("run", 0200, cbench_dir, NULL, &cbench_run_fops);
+	debugfs_create_file("results", 0400, cbench_dir, NULL,
+			    &cbench_results_fops);
+
+	return 0;
+}
+
+static void __exit crypto_bench_exit(void)
+{
+	debugfs_remove_recursive(cbench_dir);
+}
+
+module_init(crypto_bench_init);
+module_exit(crypto_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Crypto algorithm benchmark interface");
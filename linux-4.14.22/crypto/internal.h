@@ -43,6 +43,14 @@ struct crypto_larval {
 	struct crypto_alg *adult;
 	struct completion completion;
 	u32 mask;
+	bool test_async;
+};
+
+/* Self-test scheduling policies, see crypto_alg_test_mode(). */
+enum {
+	CRYPTO_TEST_SYNC,
+	CRYPTO_TEST_STRICT,
+	CRYPTO_TEST_PERMISSIVE,
 };
 
 extern struct list_head crypto_alg_list;
@@ -80,6 +88,22 @@ struct crypto_larval *crypto_larval_alloc(const char *name, u32 type, u32 mask);
 void crypto_larval_kill(struct crypto_alg *alg);
 struct crypto_alg *crypto_larval_lookup(const char *name, u32 type, u32 mask);
 void crypto_alg_tested(const char *name, int err);
+void crypto_alg_test_stats(const char *name, int err, u64 nsecs);
+
+#ifdef CONFIG_CRYPTO_MANAGER_ASYNC_TESTS
+int crypto_alg_test_mode(struct crypto_alg *alg);
+void crypto_alg_test_start(struct crypto_alg *alg);
+void crypto_alg_test_done(struct crypto_alg *alg);
+#else
+static inline int crypto_alg_test_mode(struct crypto_alg *alg)
+{
+	return CRYPTO_TEST_SYNC;
+}
+
+static inline void crypto_alg_test_done(struct crypto_alg *alg)
+{
+}
+#endif
 
 void crypto_remove_spawns(struct crypto_alg *alg, struct list_head *list,
 			  struct crypto_alg *nalg);
@@ -17,6 +17,7 @@
 #include <crypto/internal/aead.h>
 #include <crypto/mcryptd.h>
 #include <crypto/crypto_wq.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
@@ -24,6 +25,7 @@
 #include <linux/module.h>
 #include <linux/scatterlist.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/sched/stat.h>
 #include <linux/slab.h>
 #include <linux/hardirq.h>
@@ -41,6 +43,24 @@ struct mcryptd_flush_list {
 
 static struct mcryptd_flush_list __percpu *mcryptd_flist;
 
+struct mcryptd_cpu_stats {
+	unsigned long flush_timeout;
+	unsigned long flush_opportunistic;
+	unsigned long flush_full;
+	unsigned long lanes[MCRYPTD_MAX_LANES + 1];
+};
+
+static DEFINE_PER_CPU(struct mcryptd_cpu_stats, mcryptd_stats);
+
+/*
+ * Overrides the flush deadline requested by the algorithms when set: both
+ * the delay of the flush work and, through mcryptd_flush_interval(), the
+ * deadline of each job.
+ */
+static u32 mcryptd_flush_delay_us;
+
+static struct dentry *mcryptd_debugfs;
+
 struct hashd_instance_ctx {
 	struct crypto_ahash_spawn spawn;
 	struct mcryptd_queue *queue;
@@ -51,6 +71,10 @@ static void mcryptd_queue_worker(struct work_struct *work);
 void mcryptd_arm_flusher(struct mcryptd_alg_cstate *cstate, unsigned long delay)
 {
 	struct mcryptd_flush_list *flist;
+	u32 delay_us = READ_ONCE(mcryptd_flush_delay_us);
+
+	if (delay_us)
+		delay = usecs_to_jiffies(delay_us);
 
 	if (!cstate->flusher_engaged) {
 		/* put the flusher on the flush list */
@@ -66,6 +90,34 @@ void mcryptd_arm_flusher(struct mcryptd_alg_cstate *cstate, unsigned long delay)
 }
 EXPORT_SYMBOL(mcryptd_arm_flusher);
 
+/*
+ * Return the time in jiffies a job may wait for its lanes to fill before it
+ * is flushed: @interval, unless overridden in debugfs.
+ */
+unsigned long mcryptd_flush_interval(unsigned long interval)
+{
+	u32 delay_us = READ_ONCE(mcryptd_flush_delay_us);
+
+	return delay_us ? usecs_to_jiffies(delay_us) : interval;
+}
+EXPORT_SYMBOL_GPL(mcryptd_flush_interval);
+
+/*
+ * Called by multi-buffer algorithms when a job is submitted to their lane
+ * manager, with the number of lanes busy after the submission. Once all
+ * lanes are busy the manager runs the jobs itself, without waiting for a
+ * flush by mcryptd: that is counted as a full-lane flush.
+ */
+void mcryptd_account_lanes(unsigned int in_use, unsigned int nr_lanes)
+{
+	struct mcryptd_cpu_stats *stats = raw_cpu_ptr(&mcryptd_stats);
+
+	stats->lanes[min_t(unsigned int, in_use, MCRYPTD_MAX_LANES)]++;
+	if (in_use >= nr_lanes)
+		stats->flush_full++;
+}
+EXPORT_SYMBOL_GPL(mcryptd_account_lanes);
+
 static int mcryptd_init_queue(struct mcryptd_queue *queue,
 			     unsigned int max_cpu_qlen)
 {
@@ -140,6 +192,7 @@ static void mcryptd_opportunistic_flush(void)
 		list_del(&cstate->flush_list);
 		cstate->flusher_engaged = false;
 		mutex_unlock(&flist->lock);
+		this_cpu_inc(mcryptd_stats.flush_opportunistic);
 		cstate->alg_state->flusher(cstate);
 	}
 }
@@ -206,6 +259,7 @@ void mcryptd_flusher(struct work_struct *__work)
 		list_del(&alg_cpu_state->flush_list);
 		alg_cpu_state->flusher_engaged = false;
 		mutex_unlock(&flist->lock);
+		this_cpu_inc(mcryptd_stats.flush_timeout);
 		alg_state->flusher(alg_cpu_state);
 	}
 }
@@ -660,6 +714,52 @@ void mcryptd_free_ahash(struct mcryptd_ahash *tfm)
 }
 EXPORT_SYMBOL_GPL(mcryptd_free_ahash);
 
+static int mcryptd_stats_show(struct seq_file *m, void *v)
+{
+	int cpu, i;
+
+	seq_puts(m, "cpu timeout_flushes opportunistic_flushes full_lane_flushes "
+		    "lanes_in_use[0..]\n");
+
+	for_each_possible_cpu(cpu) {
+		struct mcryptd_cpu_stats *stats = per_cpu_ptr(&mcryptd_stats,
+							      cpu);
+
+		seq_printf(m, "%d %lu %lu %lu", cpu, stats->flush_timeout,
+			   stats->flush_opportunistic, stats->flush_full);
+		for (i = 0; i <= MCRYPTD_MAX_LANES; i++)
+			seq_printf(m, " %lu", stats->lanes[i]);
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
+static int mcryptd_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mcryptd_stats_show, NULL);
+}
+
+static const struct file_operations mcryptd_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mcryptd_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void mcryptd_init_debugfs(void)
+{
+	mcryptd_debugfs = debugfs_create_dir("mcryptd", NULL);
+	if (IS_ERR_OR_NULL(mcryptd_debugfs))
+		return;
+
+	debugfs_create_u32("flush_delay_us", 0644, mcryptd_debugfs,
+			   &mcryptd_flush_delay_us);
+	debugfs_create_file("stats", 0444, mcryptd_debugfs, NULL,
+			    &mcryptd_stats_fops);
+}
+
 static int __init mcryptd_init(void)
 {
 	int err, cpu;
@@ -682,13 +782,16 @@ static int __init mcryptd_init(void)
 	if (err) {
 		mcryptd_fini_queue(&mqueue);
 		free_percpu(mcryptd_flist);
+		return err;
 	}
 
-	return err;
+	mcryptd_init_debugfs();
+	return 0;
 }
 
 static void __exit mcryptd_exit(void)
 {
+	debugfs_remove_recursive(mcryptd_debugfs);
 	mcryptd_fini_queue(&mqueue);
 	crypto_unregister_template(&mcryptd_tmpl);
 	free_percpu(mcryptd_flist);
@@ -48,8 +48,11 @@ static int c_show(struct seq_file *m, void *p)
 	seq_printf(m, "priority     : %d\n", alg->cra_priority);
 	seq_printf(m, "refcnt       : %d\n", atomic_read(&alg->cra_refcnt));
 	seq_printf(m, "selftest     : %s\n",
+		   alg->cra_test_err ? "failed" :
 		   (alg->cra_flags & CRYPTO_ALG_TESTED) ?
 		   "passed" : "unknown");
+	if (alg->cra_test_nsecs)
+		seq_printf(m, "selftest time: %llu ns\n", alg->cra_test_nsecs);
 	seq_printf(m, "internal     : %s\n",
 		   (alg->cra_flags & CRYPTO_ALG_INTERNAL) ?
 		   "yes" : "no");
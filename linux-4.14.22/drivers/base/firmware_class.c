@@ -26,12 +26,17 @@
 #include <linux/file.h>
 #include <linux/list.h>
 #include <linux/fs.h>
+#include <linux/fs_struct.h>
 #include <linux/async.h>
 #include <linux/pm.h>
 #include <linux/suspend.h>
 #include <linux/syscore_ops.h>
 #include <linux/reboot.h>
 #include <linux/security.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
+#include <linux/pagemap.h>
+#include <linux/shmem_fs.h>
 
 #include <generated/utsrelease.h>
 
@@ -233,6 +238,11 @@ struct firmware_buf {
 	int nr_pages;
 	int page_array_size;
 	struct list_head pending_list;
+#endif
+#ifdef CONFIG_FW_LOADER_ROOTFS_INDEX
+	/* rootfs page cache pages mapped at data, see fw_get_rootfs_firmware() */
+	struct page **rootfs_pages;
+	int nr_rootfs_pages;
 #endif
 	const char *fw_id;
 };
@@ -253,6 +263,9 @@ struct fw_name_devm {
 #define	FW_LOADER_START_CACHE	1
 
 static int fw_cache_piggyback_on_request(const char *name);
+#ifdef CONFIG_FW_LOADER_ROOTFS_INDEX
+static void fw_rootfs_unmap(struct firmware_buf *buf);
+#endif
 
 /* fw_lock could be moved to 'struct firmware_priv' but since it is just
  * guarding for corner cases a global lock should be OK */
@@ -341,6 +354,11 @@ static void __fw_free_buf(struct kref *ref)
 	list_del(&buf->list);
 	spin_unlock(&fwc->lock);
 
+#ifdef CONFIG_FW_LOADER_ROOTFS_INDEX
+	if (buf->rootfs_pages)
+		fw_rootfs_unmap(buf);
+	else
+#endif
 #ifdef CONFIG_FW_LOADER_USER_HELPER
 	if (buf->is_paged_buf) {
 		int i;
@@ -382,6 +400,308 @@ static const char * const fw_path[] = {
 module_param_string(path, fw_path_para, sizeof(fw_path_para), 0644);
 MODULE_PARM_DESC(path, "customized firmware image search path with a higher priority than default path");
 
+#ifdef CONFIG_FW_LOADER_ROOTFS_INDEX
+/*
+ * Firmware files unpacked from the initramfs, by name relative to the
+ * fw_path[] directory they were found in.  The files are kept open until
+ * they are first loaded, so that a request maps their rootfs page cache
+ * pages instead of walking fw_path[] and reading the file into a new
+ * buffer.  Later requests for the same name walk fw_path[] as usual; the
+ * entry is kept to tell the name is in rootfs.
+ */
+#define FW_ROOTFS_HASH_BITS	6
+
+struct fw_rootfs_entry {
+	struct hlist_node node;
+	struct file *file;	/* NULL once loaded */
+	int prio;		/* index of the fw_path[] entry */
+	char name[];
+};
+
+static DEFINE_HASHTABLE(fw_rootfs_hash, FW_ROOTFS_HASH_BITS);
+static DEFINE_MUTEX(fw_rootfs_lock);
+static struct super_block *fw_rootfs_sb;
+
+/*
+ * Optionally, while the root is still the rootfs the initramfs was
+ * unpacked in, take a name missing from the index to be missing from the
+ * firmware search path too: fail it without walking fw_path[], as drivers
+ * trying several firmware versions in turn would otherwise do for each of
+ * them.  This is only right if nothing installs firmware in rootfs after
+ * boot, so it is off by default, and never applies to a custom path.
+ */
+static bool fw_rootfs_only;
+module_param_named(rootfs_index_only, fw_rootfs_only, bool, 0644);
+MODULE_PARM_DESC(rootfs_index_only, "while / is the rootfs, only look up firmware unpacked from the initramfs");
+
+static u32 fw_rootfs_hash_name(const char *name)
+{
+	return full_name_hash(NULL, name, strlen(name));
+}
+
+static struct fw_rootfs_entry *fw_rootfs_lookup(const char *name)
+{
+	struct fw_rootfs_entry *entry;
+
+	hash_for_each_possible(fw_rootfs_hash, entry, node,
+			       fw_rootfs_hash_name(name))
+		if (!strcmp(entry->name, name))
+			return entry;
+
+	return NULL;
+}
+
+static void fw_rootfs_free(struct fw_rootfs_entry *entry)
+{
+	hash_del(&entry->node);
+	if (entry->file)
+		fput(entry->file);
+	kfree(entry);
+}
+
+static bool fw_rootfs_is_root(void)
+{
+	struct path root;
+	bool ret;
+
+	if (!fw_rootfs_sb)
+		return false;
+
+	get_fs_root(current->fs, &root);
+	ret = root.mnt->mnt_sb == fw_rootfs_sb;
+	path_put(&root);
+
+	return ret;
+}
+
+/**
+ * firmware_rootfs_add() - index a file unpacked from the initramfs
+ * @path: path of the file, as found in the initramfs archive
+ *
+ * Called by the initramfs unpacker for each regular file once it is
+ * written.  Files under one of the firmware search paths are kept open
+ * and indexed by firmware name; when the same name is found under
+ * several search paths, the one searched first by request_firmware()
+ * wins.
+ */
+void __init firmware_rootfs_add(const char *path)
+{
+	struct fw_rootfs_entry *entry, *old;
+	const char *name = NULL;
+	struct file *file;
+	int i, len;
+
+	/* Archive names are relative to the root, with or without "./" */
+	while (*path == '/' || (path[0] == '.' && path[1] == '/'))
+		path += *path == '/' ? 1 : 2;
+
+	for (i = 0; i < ARRAY_SIZE(fw_path); i++) {
+		/* Only absolute search paths can be in the archive */
+		if (fw_path[i][0] != '/')
+			continue;
+
+		len = strlen(fw_path[i] + 1);
+		if (!strncmp(path, fw_path[i] + 1, len) && path[len] == '/') {
+			name = path + len + 1;
+			break;
+		}
+	}
+	if (!name || !*name)
+		return;
+
+	mutex_lock(&fw_rootfs_lock);
+	old = fw_rootfs_lookup(name);
+	if (old && old->prio <= i)
+		goto out;
+
+	entry = kmalloc(sizeof(*entry) + strlen(name) + 1, GFP_KERNEL);
+	if (!entry)
+		goto out;
+
+	file = filp_open(path, O_RDONLY, 0);
+	if (IS_ERR(file)) {
+		kfree(entry);
+		goto out;
+	}
+
+	fw_rootfs_sb = file_inode(file)->i_sb;
+	entry->file = file;
+	entry->prio = i;
+	strcpy(entry->name, name);
+	if (old)
+		fw_rootfs_free(old);
+	hash_add(fw_rootfs_hash, &entry->node, fw_rootfs_hash_name(name));
+out:
+	mutex_unlock(&fw_rootfs_lock);
+}
+
+static struct page *fw_rootfs_read_page(struct file *file, pgoff_t index)
+{
+	struct address_space *mapping = file->f_mapping;
+
+	/* rootfs is tmpfs when it is enabled, ramfs otherwise */
+	if (shmem_mapping(mapping))
+		return shmem_read_mapping_page(mapping, index);
+
+	return read_mapping_page(mapping, index, file);
+}
+
+static int fw_rootfs_map(struct firmware_buf *buf, struct file *file,
+			 size_t size)
+{
+	struct page **pages;
+	int i, nr_pages = DIV_ROUND_UP(size, PAGE_SIZE);
+	void *data;
+	int rc;
+
+	pages = kvmalloc_array(nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_pages; i++) {
+		pages[i] = fw_rootfs_read_page(file, i);
+		if (IS_ERR(pages[i])) {
+			rc = PTR_ERR(pages[i]);
+			goto err;
+		}
+	}
+
+	/* The pages are shared with the file: don't let drivers write them */
+	data = vmap(pages, nr_pages, 0, PAGE_KERNEL_RO);
+	if (!data) {
+		rc = -ENOMEM;
+		goto err;
+	}
+
+	buf->data = data;
+	buf->rootfs_pages = pages;
+	buf->nr_rootfs_pages = nr_pages;
+	return 0;
+
+err:
+	while (i--)
+		put_page(pages[i]);
+	kvfree(pages);
+	return rc;
+}
+
+static void fw_rootfs_unmap(struct firmware_buf *buf)
+{
+	int i;
+
+	vunmap(buf->data);
+	for (i = 0; i < buf->nr_rootfs_pages; i++)
+		put_page(buf->rootfs_pages[i]);
+	kvfree(buf->rootfs_pages);
+	buf->data = NULL;
+	buf->rootfs_pages = NULL;
+	buf->nr_rootfs_pages = 0;
+}
+
+/*
+ * Returns 0 or a negative error if @buf was loaded or failed from the
+ * index, 1 if it has to be looked up in the filesystem.
+ */
+static int fw_get_rootfs_firmware(struct device *device,
+				  struct firmware_buf *buf,
+				  enum kernel_read_file_id id, size_t msize)
+{
+	struct fw_rootfs_entry *entry;
+	struct file *file = NULL;
+	bool indexed = false;
+	loff_t size, pos = 0;
+	int rc;
+
+	mutex_lock(&fw_rootfs_lock);
+	entry = fw_rootfs_lookup(buf->fw_id);
+	if (entry) {
+		/*
+		 * Unlinked since, e.g. replaced by a rename or removed when
+		 * switching away from rootfs: whatever has the name now is
+		 * found by the path walk.
+		 */
+		if (entry->file && !file_inode(entry->file)->i_nlink) {
+			fput(entry->file);
+			entry->file = NULL;
+		}
+		indexed = true;
+		if (entry->file)
+			file = get_file(entry->file);
+	}
+	mutex_unlock(&fw_rootfs_lock);
+
+	if (!file) {
+		if (!indexed && READ_ONCE(fw_rootfs_only) &&
+		    !fw_path_para[0] && fw_rootfs_is_root()) {
+			dev_dbg(device, "%s is not in the initramfs\n",
+				buf->fw_id);
+			return -ENOENT;
+		}
+		return 1;
+	}
+
+	rc = security_kernel_read_file(file, id);
+	if (rc)
+		goto out;
+
+	size = i_size_read(file_inode(file));
+	if (size <= 0) {
+		rc = -EINVAL;
+		goto out;
+	}
+	if (size > msize) {
+		rc = -EFBIG;
+		goto out;
+	}
+
+	/* A caller supplied buffer gets a copy, there is nothing to share */
+	if (buf->data) {
+		if (kernel_read(file, buf->data, size, &pos) != size) {
+			rc = -EIO;
+			goto out;
+		}
+	} else {
+		rc = fw_rootfs_map(buf, file, size);
+		if (rc)
+			goto out;
+	}
+
+	rc = security_kernel_post_read_file(file, buf->data, size, id);
+	if (rc) {
+		if (buf->rootfs_pages)
+			fw_rootfs_unmap(buf);
+		goto out;
+	}
+
+	dev_dbg(device, "rootfs-loading %s\n", buf->fw_id);
+	buf->size = size;
+	fw_state_done(&buf->fw_st);
+
+	/* Don't keep the file around once its pages are shared or copied */
+	mutex_lock(&fw_rootfs_lock);
+	entry = fw_rootfs_lookup(buf->fw_id);
+	if (entry && entry->file == file) {
+		fput(entry->file);
+		entry->file = NULL;
+	}
+	mutex_unlock(&fw_rootfs_lock);
+out:
+	if (rc)
+		dev_warn(device, "loading %s from rootfs failed with error %d\n",
+			 buf->fw_id, rc);
+	fput(file);
+	return rc;
+}
+#else
+static inline int fw_get_rootfs_firmware(struct device *device,
+					 struct firmware_buf *buf,
+					 enum kernel_read_file_id id,
+					 size_t msize)
+{
+	return 1;
+}
+#endif /* CONFIG_FW_LOADER_ROOTFS_INDEX */
+
 static int
 fw_get_filesystem_firmware(struct device *device, struct firmware_buf *buf)
 {
@@ -398,6 +718,12 @@ fw_get_filesystem_firmware(struct device *device, struct firmware_buf *buf)
 		msize = buf->allocated_size;
 	}
 
+	/* Files unpacked from the initramfs need no path walk */
+	rc = fw_get_rootfs_firmware(device, buf, id, msize);
+	if (rc <= 0)
+		return rc;
+	rc = -ENOENT;
+
 	path = __getname();
 	if (!path)
 		return -ENOMEM;
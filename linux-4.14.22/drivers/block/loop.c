@@ -85,6 +85,8 @@ static DEFINE_MUTEX(loop_index_mutex);
 
 static int max_part;
 static int part_shift;
+static unsigned int nr_hw_queues = 1;
+static bool direct_io;
 
 static int transfer_xor(struct loop_device *lo, int cmd,
 			struct page *raw_page, unsigned raw_off,
@@ -180,17 +182,16 @@ static void __loop_update_dio(struct loop_device *lo, bool dio)
 
 	/*
 	 * We support direct I/O only if lo_offset is aligned with the
-	 * logical I/O size of backing device, and the logical block
-	 * size of loop is bigger than the backing device's and the loop
-	 * needn't transform transfer.
+	 * logical I/O size of backing device and the loop needn't
+	 * transform transfer.
 	 *
-	 * TODO: the above condition may be loosed in the future, and
-	 * direct I/O may be switched runtime at that time because most
-	 * of requests in sane applications should be PAGE_SIZE aligned
+	 * If the logical block size of loop is smaller than the backing
+	 * device's, requests that are not aligned to the latter are
+	 * handled with buffered I/O one by one, see lo_rq_dio_aligned().
+	 * Most requests in sane applications are PAGE_SIZE aligned.
 	 */
 	if (dio) {
-		if (queue_logical_block_size(lo->lo_queue) >= sb_bsize &&
-				!(lo->lo_offset & dio_align) &&
+		if (!(lo->lo_offset & dio_align) &&
 				mapping->a_ops->direct_IO &&
 				!lo->transfer)
 			use_dio = true;
@@ -200,6 +201,7 @@ static void __loop_update_dio(struct loop_device *lo, bool dio)
 		use_dio = false;
 	}
 
+	lo->dio_align = dio_align;
 	if (lo->use_dio == use_dio)
 		return;
 
@@ -826,8 +828,18 @@ static void loop_config_discard(struct loop_device *lo)
 
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	unsigned int i;
+
+	for (i = 0; i < lo->tag_set.nr_hw_queues; i++) {
+		struct loop_worker *w = &lo->workers[i];
+
+		if (!w->task)
+			break;
+		kthread_flush_worker(&w->worker);
+		kthread_stop(w->task);
+	}
+	kfree(lo->workers);
+	lo->workers = NULL;
 }
 
 static int loop_kthread_worker_fn(void *worker_ptr)
@@ -836,14 +848,37 @@ static int loop_kthread_worker_fn(void *worker_ptr)
 	return kthread_worker_fn(worker_ptr);
 }
 
+/*
+ * Each hardware queue has its own worker thread, so that buffered I/O
+ * submitted from several CPUs is handled concurrently.
+ */
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	unsigned int nr = lo->tag_set.nr_hw_queues;
+	unsigned int i;
+
+	lo->workers = kcalloc(nr, sizeof(*lo->workers), GFP_KERNEL);
+	if (!lo->workers)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	for (i = 0; i < nr; i++) {
+		struct loop_worker *w = &lo->workers[i];
+		struct task_struct *task;
+
+		kthread_init_worker(&w->worker);
+		if (nr == 1)
+			task = kthread_run(loop_kthread_worker_fn, &w->worker,
+					   "loop%d", lo->lo_number);
+		else
+			task = kthread_run(loop_kthread_worker_fn, &w->worker,
+					   "loop%d/%u", lo->lo_number, i);
+		if (IS_ERR(task)) {
+			loop_unprepare_queue(lo);
+			return -ENOMEM;
+		}
+		set_user_nice(task, MIN_NICE);
+		w->task = task;
+	}
 	return 0;
 }
 
@@ -921,7 +956,7 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_write_cache(lo->lo_queue, true, false);
 
-	loop_update_dio(lo);
+	__loop_update_dio(lo, io_is_direct(file) || direct_io);
 	set_capacity(lo->lo_disk, size);
 	bd_set_size(bdev, size << 9);
 	loop_sysfs_init(lo);
@@ -1629,6 +1664,10 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(nr_hw_queues, uint, S_IRUGO);
+MODULE_PARM_DESC(nr_hw_queues, "Number of hardware queues and worker threads per loop device, 0 for one per CPU");
+module_param(direct_io, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(direct_io, "Bypass the page cache of the backing file when possible");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1670,6 +1709,29 @@ int loop_unregister_transfer(int number)
 EXPORT_SYMBOL(loop_register_transfer);
 EXPORT_SYMBOL(loop_unregister_transfer);
 
+/*
+ * Direct I/O needs the position, the length and every segment aligned to
+ * the logical block size of the backing device. That is a given if the
+ * loop block size is at least as large, otherwise check the request.
+ */
+static bool lo_rq_dio_aligned(struct loop_device *lo, struct request *rq)
+{
+	struct req_iterator iter;
+	struct bio_vec bvec;
+
+	if (queue_logical_block_size(lo->lo_queue) > lo->dio_align)
+		return true;
+
+	if (((blk_rq_pos(rq) << 9) | blk_rq_bytes(rq)) & lo->dio_align)
+		return false;
+
+	rq_for_each_segment(bvec, rq, iter) {
+		if ((bvec.bv_offset | bvec.bv_len) & lo->dio_align)
+			return false;
+	}
+	return true;
+}
+
 static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		const struct blk_mq_queue_data *bd)
 {
@@ -1688,11 +1750,11 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		cmd->use_aio = false;
 		break;
 	default:
-		cmd->use_aio = lo->use_dio;
+		cmd->use_aio = lo->use_dio && lo_rq_dio_aligned(lo, cmd->rq);
 		break;
 	}
 
-	kthread_queue_work(&lo->worker, &cmd->work);
+	kthread_queue_work(&lo->workers[hctx->queue_num].worker, &cmd->work);
 
 	return BLK_STS_OK;
 }
@@ -1769,7 +1831,7 @@ static int loop_add(struct loop_device **l, int i)
 
 	err = -ENOMEM;
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = nr_hw_queues ? nr_hw_queues : nr_cpu_ids;
 	lo->tag_set.queue_depth = 128;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
@@ -26,6 +26,11 @@ enum {
 
 struct loop_func_table;
 
+struct loop_worker {
+	struct kthread_worker	worker;
+	struct task_struct	*task;
+};
+
 struct loop_device {
 	int		lo_number;
 	atomic_t	lo_refcnt;
@@ -55,9 +60,9 @@ struct loop_device {
 	spinlock_t		lo_lock;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
+	struct loop_worker	*workers;	/* one per hardware queue */
 	bool			use_dio;
+	unsigned		dio_align;	/* backing direct I/O alignment mask */
 
 	struct request_queue	*lo_queue;
 	struct blk_mq_tag_set	tag_set;
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *               2012, 2013 Minchan Kim
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ */
+
+/*
+ * Deduplication of pages with the same content: every stored object is
+ * indexed by the xxhash of its uncompressed page, and a page written with
+ * the same content as an indexed one just takes a reference on it.
+ * Candidates with the same hash are decompressed and compared in full, so
+ * a hash collision never makes two different pages share an object.
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/highmem.h>
+#include <linux/log2.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/xxhash.h>
+
+#include "zram_drv.h"
+
+/* Number of stored pages per hash bucket, each bucket is an rbtree */
+#define ZRAM_DEDUP_PAGES_PER_BUCKET	128
+
+struct zram_dedup_bucket {
+	spinlock_t lock;
+	struct rb_root tree;
+};
+
+unsigned long zram_dedup_checksum(struct page *page)
+{
+	unsigned long checksum;
+	void *mem;
+
+	mem = kmap_atomic(page);
+#if BITS_PER_LONG == 64
+	checksum = xxh64(mem, PAGE_SIZE, 0);
+#else
+	checksum = xxh32(mem, PAGE_SIZE, 0);
+#endif
+	kunmap_atomic(mem);
+
+	return checksum;
+}
+
+static struct zram_dedup_bucket *zram_dedup_bucket(struct zram *zram,
+						   unsigned long checksum)
+{
+	return &zram->dedup_buckets[checksum & (zram->dedup_nr_buckets - 1)];
+}
+
+/* Is @entry a copy of @page? Called with the bucket lock held. */
+static bool zram_dedup_match(struct zram *zram, struct zram_dedup_entry *entry,
+			     struct page *page)
+{
+	struct zcomp_strm *zstrm;
+	bool match = false;
+	void *src, *mem;
+
+	src = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	mem = kmap_atomic(page);
+	if (entry->len == PAGE_SIZE) {
+		match = !memcmp(mem, src, PAGE_SIZE);
+	} else {
+		zstrm = zcomp_stream_get(zram->comp);
+		if (!zcomp_decompress(zstrm, src, entry->len, zstrm->buffer))
+			match = !memcmp(mem, zstrm->buffer, PAGE_SIZE);
+		zcomp_stream_put(zram->comp);
+	}
+	kunmap_atomic(mem);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look for a stored copy of @page, and take a reference on it if there is
+ * one.
+ */
+struct zram_dedup_entry *zram_dedup_find(struct zram *zram, struct page *page,
+					 unsigned long checksum)
+{
+	struct zram_dedup_bucket *bucket = zram_dedup_bucket(zram, checksum);
+	struct zram_dedup_entry *entry = NULL;
+	struct rb_node *node, *prev;
+
+	spin_lock(&bucket->lock);
+	node = bucket->tree.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zram_dedup_entry, rb_node);
+		if (checksum == entry->checksum)
+			break;
+		node = checksum < entry->checksum ?
+			node->rb_left : node->rb_right;
+	}
+	if (!node)
+		goto miss;
+
+	/* Go to the first entry with this checksum, then try them all */
+	while ((prev = rb_prev(node)) &&
+	       rb_entry(prev, struct zram_dedup_entry, rb_node)->checksum ==
+			checksum)
+		node = prev;
+
+	for (; node; node = rb_next(node)) {
+		entry = rb_entry(node, struct zram_dedup_entry, rb_node);
+		if (entry->checksum != checksum)
+			break;
+		if (zram_dedup_match(zram, entry, page)) {
+			entry->refcount++;
+			spin_unlock(&bucket->lock);
+			atomic64_add(entry->len, &zram->stats.dup_data_size);
+			return entry;
+		}
+	}
+miss:
+	spin_unlock(&bucket->lock);
+	return NULL;
+}
+
+/*
+ * Index the object just stored for a page with @checksum.  Returns NULL if
+ * the entry can't be allocated, in which case the object is simply not
+ * shared.
+ */
+struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, unsigned int len, unsigned long checksum)
+{
+	struct zram_dedup_bucket *bucket = zram_dedup_bucket(zram, checksum);
+	struct zram_dedup_entry *entry, *p;
+	struct rb_node **node, *parent = NULL;
+
+	entry = kmalloc(sizeof(*entry),
+			GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->handle = handle;
+	entry->len = len;
+	entry->refcount = 1;
+
+	spin_lock(&bucket->lock);
+	node = &bucket->tree.rb_node;
+	while (*node) {
+		parent = *node;
+		p = rb_entry(parent, struct zram_dedup_entry, rb_node);
+		if (checksum < p->checksum)
+			node = &parent->rb_left;
+		else
+			node = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, node);
+	rb_insert_color(&entry->rb_node, &bucket->tree);
+	spin_unlock(&bucket->lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
+
+/* Drop a page's reference, freeing the object with the last one */
+void zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry)
+{
+	struct zram_dedup_bucket *bucket;
+
+	bucket = zram_dedup_bucket(zram, entry->checksum);
+	spin_lock(&bucket->lock);
+	if (--entry->refcount) {
+		spin_unlock(&bucket->lock);
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		return;
+	}
+	rb_erase(&entry->rb_node, &bucket->tree);
+	spin_unlock(&bucket->lock);
+
+	zs_free(zram->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	kfree(entry);
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	unsigned long i, nr;
+
+	if (!zram_dedup_enabled(zram))
+		return 0;
+
+	nr = roundup_pow_of_two(max_t(size_t, 1,
+			num_pages / ZRAM_DEDUP_PAGES_PER_BUCKET));
+	zram->dedup_buckets = vzalloc(nr * sizeof(*zram->dedup_buckets));
+	if (!zram->dedup_buckets)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		spin_lock_init(&zram->dedup_buckets[i].lock);
+		zram->dedup_buckets[i].tree = RB_ROOT;
+	}
+	zram->dedup_nr_buckets = nr;
+
+	return 0;
+}
+
+/* Called once all the pages have been freed */
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->dedup_buckets);
+	zram->dedup_buckets = NULL;
+	zram->dedup_nr_buckets = 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *               2012, 2013 Minchan Kim
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/rbtree.h>
+
+struct zram;
+
+/*
+ * A compressed object shared by all the pages with its content.  Such a
+ * page has the ZRAM_DEDUP flag set and its table handle points to this
+ * entry instead of to the zsmalloc object.
+ */
+struct zram_dedup_entry {
+	struct rb_node rb_node;
+	unsigned long checksum;
+	unsigned long handle;
+	unsigned int len;
+	unsigned int refcount;	/* protected by the bucket lock */
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+unsigned long zram_dedup_checksum(struct page *page);
+struct zram_dedup_entry *zram_dedup_find(struct zram *zram, struct page *page,
+					 unsigned long checksum);
+struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, unsigned int len, unsigned long checksum);
+void zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry);
+
+int zram_dedup_init(struct zram *zram, size_t num_pages);
+void zram_dedup_fini(struct zram *zram);
+#else
+static inline unsigned long zram_dedup_checksum(struct page *page)
+{
+	return 0;
+}
+static inline struct zram_dedup_entry *zram_dedup_find(struct zram *zram,
+		struct page *page, unsigned long checksum)
+{
+	return NULL;
+}
+static inline struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, unsigned int len, unsigned long checksum)
+{
+	return NULL;
+}
+static inline void zram_dedup_put(struct zram *zram,
+				  struct zram_dedup_entry *entry) {}
+
+static inline int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	return 0;
+}
+static inline void zram_dedup_fini(struct zram *zram) {}
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -32,6 +32,9 @@
 #include <linux/idr.h>
 #include <linux/sysfs.h>
 #include <linux/cpuhotplug.h>
+#include <linux/workqueue.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/mm.h>
 
 #include "zram_drv.h"
 
@@ -44,6 +47,9 @@ static const char *default_compressor = "lzo";
 
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
+static bool parallel_writes = true;
+
+static struct workqueue_struct *zram_write_wq;
 
 static void zram_free_page(struct zram *zram, size_t index);
 
@@ -666,6 +672,42 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -707,6 +749,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 	struct zs_pool_stats pool_stats;
 	u64 orig_size, mem_used = 0;
+	u64 comp_kbytes, comp_msecs;
 	long max_used;
 	ssize_t ret;
 
@@ -721,15 +764,25 @@ static ssize_t mm_stat_show(struct device *dev,
 	orig_size = atomic64_read(&zram->stats.pages_stored);
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
+	/* Compression throughput, in KiB of input per second of CPU time */
+	comp_kbytes = atomic64_read(&zram->stats.comp_pages) <<
+			(PAGE_SHIFT - 10);
+	comp_msecs = div64_u64(atomic64_read(&zram->stats.comp_nsecs),
+			       NSEC_PER_MSEC);
+
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
-			pool_stats.pages_compacted);
+			pool_stats.pages_compacted,
+			comp_msecs ? div64_u64(comp_kbytes * MSEC_PER_SEC,
+					       comp_msecs) : 0,
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -775,6 +828,7 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 	for (index = 0; index < num_pages; index++)
 		zram_free_page(zram, index);
 
+	zram_dedup_fini(zram);
 	zs_destroy_pool(zram->mem_pool);
 	vfree(zram->table);
 }
@@ -794,6 +848,12 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 		return false;
 	}
 
+	if (zram_dedup_init(zram, num_pages)) {
+		zs_destroy_pool(zram->mem_pool);
+		vfree(zram->table);
+		return false;
+	}
+
 	return true;
 }
 
@@ -824,6 +884,17 @@ static void zram_free_page(struct zram *zram, size_t index)
 		return;
 	}
 
+	/* The object is freed with the last page sharing it */
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, (struct zram_dedup_entry *)
+				zram_get_element(zram, index));
+		atomic64_dec(&zram->stats.pages_stored);
+		zram_set_handle(zram, index, 0);
+		zram_set_obj_size(zram, index, 0);
+		return;
+	}
+
 	handle = zram_get_handle(zram, index);
 	if (!handle)
 		return;
@@ -877,6 +948,8 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		return 0;
 	}
 
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		handle = ((struct zram_dedup_entry *)handle)->handle;
 	size = zram_get_obj_size(zram, index);
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
@@ -949,6 +1022,9 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
 	bool allow_wb = true;
+	struct zram_dedup_entry *entry;
+	unsigned long checksum = 0;
+	u64 start;
 
 	mem = kmap_atomic(page);
 	if (page_same_filled(mem, &element)) {
@@ -960,10 +1036,24 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	}
 	kunmap_atomic(mem);
 
+	if (zram_dedup_enabled(zram)) {
+		checksum = zram_dedup_checksum(page);
+		entry = zram_dedup_find(zram, page, checksum);
+		if (entry) {
+			flags = ZRAM_DEDUP;
+			element = (unsigned long)entry;
+			comp_len = entry->len;
+			goto out;
+		}
+	}
+
 compress_again:
 	zstrm = zcomp_stream_get(zram->comp);
 	src = kmap_atomic(page);
+	start = local_clock();
 	ret = zcomp_compress(zstrm, src, &comp_len);
+	atomic64_add(local_clock() - start, &zram->stats.comp_nsecs);
+	atomic64_inc(&zram->stats.comp_pages);
 	kunmap_atomic(src);
 
 	if (unlikely(ret)) {
@@ -1039,6 +1129,15 @@ compress_again:
 	zcomp_stream_put(zram->comp);
 	zs_unmap_object(zram->mem_pool, handle);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
+
+	/* If the index can't take it, the object just isn't shared */
+	if (zram_dedup_enabled(zram)) {
+		entry = zram_dedup_insert(zram, handle, comp_len, checksum);
+		if (entry) {
+			flags = ZRAM_DEDUP;
+			element = (unsigned long)entry;
+		}
+	}
 out:
 	/*
 	 * Free memory associated with this sector
@@ -1050,6 +1149,8 @@ out:
 	if (flags) {
 		zram_set_flag(zram, index, flags);
 		zram_set_element(zram, index, element);
+		if (flags == ZRAM_DEDUP)
+			zram_set_obj_size(zram, index, comp_len);
 	}  else {
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
@@ -1177,6 +1278,169 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+/*
+ * Writes of several pages are compressed in parallel, by work items on the
+ * unbound zram_write_wq that each take up to ZRAM_WRITE_BATCH pages.  The
+ * bio completes when the last of them is done.  A page written through
+ * rw_page, which is how swap writes to zram, is handed to a work item too,
+ * so that reclaim can go on with its next page meanwhile.  At most
+ * ZRAM_MAX_ASYNC_WRITES such pages are queued per device; past that, rw_page
+ * compresses the page in place, which throttles reclaim as before.  Work
+ * items queued from reclaim run with PF_MEMALLOC like their submitter, so
+ * that storing a page can use the reserves it is meant to replenish.
+ */
+#define ZRAM_WRITE_BATCH	8
+#define ZRAM_MAX_ASYNC_WRITES	256
+
+struct zram_write_work {
+	struct work_struct work;
+	struct zram_write_req *req;
+	u32 index;		/* index of the first page */
+	unsigned int first;	/* its position in req->bvecs */
+	unsigned int nr_pages;
+};
+
+struct zram_write_req {
+	struct zram *zram;
+	struct bio *bio;		/* NULL for rw_page */
+	atomic_t pending;		/* work items still running */
+	bool memalloc;			/* submitted with PF_MEMALLOC */
+	blk_status_t status;
+	struct zram_write_work *works;
+	struct bio_vec *bvecs;
+};
+
+static struct zram_write_req *zram_write_req_alloc(struct zram *zram,
+		struct bio *bio, unsigned int nr_pages, gfp_t gfp)
+{
+	unsigned int nr_works = DIV_ROUND_UP(nr_pages, ZRAM_WRITE_BATCH);
+	struct zram_write_req *req;
+
+	req = kmalloc(sizeof(*req) + nr_works * sizeof(*req->works) +
+		      nr_pages * sizeof(*req->bvecs), gfp);
+	if (!req)
+		return NULL;
+
+	req->zram = zram;
+	req->bio = bio;
+	atomic_set(&req->pending, nr_works);
+	req->memalloc = current->flags & PF_MEMALLOC;
+	req->status = BLK_STS_OK;
+	req->works = (struct zram_write_work *)(req + 1);
+	req->bvecs = (struct bio_vec *)(req->works + nr_works);
+	return req;
+}
+
+static void zram_write_req_end(struct zram_write_req *req, int ret)
+{
+	struct page *page;
+
+	if (req->bio) {
+		req->bio->bi_status = req->status;
+		bio_endio(req->bio);
+		goto out;
+	}
+
+	/* rw_page: 1 means the page went to the backing device */
+	atomic_dec(&req->zram->async_writes);
+	page = req->bvecs[0].bv_page;
+	if (ret == 1)
+		goto out;
+	if (ret < 0) {
+		/*
+		 * rw_page already returned success, so the caller won't
+		 * retry: keep the page dirty, as end_swap_bio_write() does,
+		 * so that it is not reclaimed with its data lost.
+		 */
+		SetPageError(page);
+		set_page_dirty(page);
+		ClearPageReclaim(page);
+	}
+	end_page_writeback(page);
+out:
+	kfree(req);
+}
+
+static void zram_write_work_fn(struct work_struct *work)
+{
+	struct zram_write_work *ww = container_of(work,
+					struct zram_write_work, work);
+	struct zram_write_req *req = ww->req;
+	unsigned int i, noreclaim_flag = 0;
+	int ret = 0;
+
+	if (req->memalloc)
+		noreclaim_flag = memalloc_noreclaim_save();
+
+	for (i = 0; i < ww->nr_pages; i++) {
+		ret = zram_bvec_rw(req->zram, &req->bvecs[ww->first + i],
+				   ww->index + i, 0, true, req->bio);
+		if (ret < 0)
+			req->status = BLK_STS_IOERR;
+	}
+
+	if (req->memalloc)
+		memalloc_noreclaim_restore(noreclaim_flag);
+
+	if (atomic_dec_and_test(&req->pending))
+		zram_write_req_end(req, ret);
+}
+
+static void zram_write_req_submit(struct zram_write_req *req, u32 index,
+				  unsigned int nr_pages)
+{
+	unsigned int i, nr_works = atomic_read(&req->pending);
+
+	for (i = 0; i < nr_works; i++) {
+		struct zram_write_work *ww = &req->works[i];
+
+		INIT_WORK(&ww->work, zram_write_work_fn);
+		ww->req = req;
+		ww->first = i * ZRAM_WRITE_BATCH;
+		ww->index = index + ww->first;
+		ww->nr_pages = min_t(unsigned int, ZRAM_WRITE_BATCH,
+				     nr_pages - ww->first);
+		queue_work(zram_write_wq, &ww->work);
+	}
+}
+
+static bool zram_can_write_parallel(void)
+{
+	return parallel_writes && num_online_cpus() > 1;
+}
+
+/*
+ * Hand a page aligned write of more than ZRAM_WRITE_BATCH whole pages over
+ * to zram_write_wq.  Returns false if the bio must be handled in place.
+ */
+static bool zram_write_parallel(struct zram *zram, struct bio *bio, u32 index)
+{
+	unsigned int nr_pages = bio->bi_iter.bi_size >> PAGE_SHIFT;
+	struct zram_write_req *req;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	unsigned int i = 0;
+
+	if (!zram_can_write_parallel() || nr_pages <= ZRAM_WRITE_BATCH)
+		return false;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		if (bvec.bv_offset || bvec.bv_len != PAGE_SIZE)
+			return false;
+	}
+
+	req = zram_write_req_alloc(zram, bio, nr_pages,
+				   GFP_NOIO | __GFP_NOWARN);
+	if (!req)
+		return false;
+
+	bio_for_each_segment(bvec, bio, iter)
+		req->bvecs[i++] = bvec;
+
+	zram_write_req_submit(req, index, nr_pages);
+	return true;
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
@@ -1194,6 +1458,10 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		zram_bio_discard(zram, index, offset, bio);
 		bio_endio(bio);
 		return;
+	case REQ_OP_WRITE:
+		if (!offset && zram_write_parallel(zram, bio, index))
+			return;
+		break;
 	default:
 		break;
 	}
@@ -1282,6 +1550,25 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	bv.bv_len = PAGE_SIZE;
 	bv.bv_offset = 0;
 
+	if (is_write && !offset && zram_can_write_parallel()) {
+		struct zram_write_req *req = NULL;
+
+		/*
+		 * reclaim calls us: don't wait for memory, and write the page
+		 * in place once too many are queued.
+		 */
+		if (atomic_inc_return(&zram->async_writes) <=
+		    ZRAM_MAX_ASYNC_WRITES)
+			req = zram_write_req_alloc(zram, NULL, 1,
+						   GFP_NOWAIT | __GFP_NOWARN);
+		if (req) {
+			req->bvecs[0] = bv;
+			zram_write_req_submit(req, index, 1);
+			return 0;
+		}
+		atomic_dec(&zram->async_writes);
+	}
+
 	ret = zram_bvec_rw(zram, &bv, index, offset, is_write, NULL);
 out:
 	/*
@@ -1330,6 +1617,8 @@ static void zram_reset_device(struct zram *zram)
 	part_stat_set_all(&zram->disk->part0, 0);
 
 	up_write(&zram->init_lock);
+	/* Wait for writes still being compressed */
+	flush_workqueue(zram_write_wq);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
@@ -1463,6 +1752,9 @@ static DEVICE_ATTR_RW(comp_algorithm);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 #endif
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -1475,6 +1767,9 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_comp_algorithm.attr,
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
+#endif
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
 #endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
@@ -1712,21 +2007,30 @@ static void destroy_devices(void)
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+	destroy_workqueue(zram_write_wq);
 }
 
 static int __init zram_init(void)
 {
 	int ret;
 
+	zram_write_wq = alloc_workqueue("zram_write",
+					WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!zram_write_wq)
+		return -ENOMEM;
+
 	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
 				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
-	if (ret < 0)
+	if (ret < 0) {
+		destroy_workqueue(zram_write_wq);
 		return ret;
+	}
 
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return ret;
 	}
 
@@ -1735,6 +2039,7 @@ static int __init zram_init(void)
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return -EBUSY;
 	}
 
@@ -1764,6 +2069,8 @@ module_exit(zram_exit);
 
 module_param(num_devices, uint, 0);
 MODULE_PARM_DESC(num_devices, "Number of pre-created zram devices");
+module_param(parallel_writes, bool, 0644);
+MODULE_PARM_DESC(parallel_writes, "Compress multi-page and swap writes in parallel");
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("Nitin Gupta <ngupta@vflare.org>");
@@ -20,6 +20,7 @@
 #include <linux/crypto.h>
 
 #include "zcomp.h"
+#include "zram_dedup.h"
 
 /*-- Configurable parameters */
 
@@ -64,6 +65,7 @@ enum zram_pageflags {
 	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
 	ZRAM_WB,	/* page is stored on backing_device */
+	ZRAM_DEDUP,	/* page shares a zram_dedup_entry */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -91,6 +93,10 @@ struct zram_stats {
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
+	atomic64_t comp_pages;		/* no. of pages compressed */
+	atomic64_t comp_nsecs;		/* time spent compressing them */
+	atomic64_t dup_data_size;	/* compressed size saved by dedup */
+	atomic64_t meta_data_size;	/* size of the dedup index */
 };
 
 struct zram {
@@ -116,6 +122,8 @@ struct zram {
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
+	/* rw_page writes queued to zram_write_wq and not completed yet */
+	atomic_t async_writes;
 #ifdef CONFIG_ZRAM_WRITEBACK
 	struct file *backing_dev;
 	struct block_device *bdev;
@@ -124,5 +132,19 @@ struct zram {
 	unsigned long nr_pages;
 	spinlock_t bitmap_lock;
 #endif
+#ifdef CONFIG_ZRAM_DEDUP
+	bool use_dedup;
+	struct zram_dedup_bucket *dedup_buckets;
+	unsigned long dedup_nr_buckets;
+#endif
 };
+
+#ifdef CONFIG_ZRAM_DEDUP
+static inline bool zram_dedup_enabled(struct zram *zram)
+{
+	return zram->use_dedup;
+}
+#else
+static inline bool zram_dedup_enabled(struct zram *zram) { return false; }
+#endif
 #endif
@@ -754,15 +754,25 @@ static int credit_entropy_bits_safe(struct entropy_store *r, int nbits)
 
 static DECLARE_WAIT_QUEUE_HEAD(crng_init_wait);
 
-#ifdef CONFIG_NUMA
 /*
- * Hack to deal with crazy userspace progams when they are all trying
- * to access /dev/urandom in parallel.  The programs are almost
- * certainly doing something terribly wrong, but we'll work around
- * their brain damage.
+ * Per-CPU CRNGs keyed from primary_crng.  Each one is only touched by
+ * its own CPU with interrupts disabled, so parallel readers of
+ * /dev/urandom and get_random_bytes() never contend on a lock.  Every
+ * reseed of primary_crng bumps crng_generation, which makes the per-CPU
+ * instances rekey on their next use.
  */
-static struct crng_state **crng_node_pool __read_mostly;
-#endif
+struct crng_pcpu {
+	__u32		state[16];
+	unsigned long	init_time;
+	unsigned long	generation;
+};
+
+static DEFINE_PER_CPU(struct crng_pcpu, crng_pcpu);
+static unsigned long crng_generation = 1;
+static bool crng_pcpu_enabled __read_mostly;
+
+static void crng_reseed_worker(struct work_struct *work);
+static DECLARE_WORK(crng_reseed_work, crng_reseed_worker);
 
 static void invalidate_batched_entropy(void);
 
@@ -840,6 +850,8 @@ static void crng_reseed(struct crng_state *crng, struct entropy_store *r)
 	}
 	memzero_explicit(&buf, sizeof(buf));
 	crng->init_time = jiffies;
+	if (crng == &primary_crng)
+		WRITE_ONCE(crng_generation, crng_generation + 1);
 	spin_unlock_irqrestore(&primary_crng.lock, flags);
 	if (crng == &primary_crng && crng_init < 2) {
 		invalidate_batched_entropy();
@@ -867,17 +879,120 @@ static void _extract_crng(struct crng_state *crng,
 	spin_unlock_irqrestore(&crng->lock, flags);
 }
 
+static void crng_reseed_worker(struct work_struct *work)
+{
+	crng_reseed(&primary_crng, &input_pool);
+}
+
+static bool crng_pcpu_usable(void)
+{
+	return READ_ONCE(crng_pcpu_enabled) && crng_ready();
+}
+
+/*
+ * Rekey a per-CPU CRNG from primary_crng.  Runs with interrupts disabled,
+ * so a due reseed of primary_crng from the input pool is left to a work
+ * item instead of being done inline.
+ */
+static void crng_pcpu_rekey(struct crng_pcpu *pcrng)
+{
+	unsigned long	flags;
+	__u32		*s, *d;
+	int		i;
+	union {
+		__u8	block[CHACHA20_BLOCK_SIZE];
+		__u32	key[8];
+	} buf;
+
+	if (crng_init > 1 &&
+	    time_after(jiffies, primary_crng.init_time + CRNG_RESEED_INTERVAL))
+		schedule_work(&crng_reseed_work);
+
+	spin_lock_irqsave(&primary_crng.lock, flags);
+	pcrng->generation = crng_generation;
+	chacha20_block(&primary_crng.state[0], buf.block);
+	if (primary_crng.state[12] == 0)
+		primary_crng.state[13]++;
+	/* Backtrack protection for primary_crng with the unused half. */
+	s = (__u32 *) &buf.block[CHACHA20_KEY_SIZE];
+	d = &primary_crng.state[4];
+	for (i = 0; i < 8; i++)
+		*d++ ^= *s++;
+	spin_unlock_irqrestore(&primary_crng.lock, flags);
+
+	memcpy(&pcrng->state[0], "expand 32-byte k", 16);
+	for (i = 0; i < 8; i++) {
+		unsigned long	rv;
+		if (!arch_get_random_long(&rv))
+			rv = random_get_entropy();
+		pcrng->state[i + 4] = buf.key[i] ^ rv;
+	}
+	memset(&pcrng->state[12], 0, 4 * sizeof(__u32));
+	pcrng->init_time = jiffies;
+	memzero_explicit(&buf, sizeof(buf));
+}
+
+/* Must be called with interrupts disabled. */
+static struct crng_pcpu *crng_pcpu_get(void)
+{
+	struct crng_pcpu *pcrng = this_cpu_ptr(&crng_pcpu);
+
+	if (unlikely(pcrng->generation != READ_ONCE(crng_generation) ||
+		     time_after(jiffies,
+				pcrng->init_time + CRNG_RESEED_INTERVAL)))
+		crng_pcpu_rekey(pcrng);
+
+	return pcrng;
+}
+
+static void crng_pcpu_block(struct crng_pcpu *pcrng,
+			    __u8 out[CHACHA20_BLOCK_SIZE])
+{
+	chacha20_block(&pcrng->state[0], out);
+	if (pcrng->state[12] == 0)
+		pcrng->state[13]++;
+}
+
 static void extract_crng(__u8 out[CHACHA20_BLOCK_SIZE])
 {
-	struct crng_state *crng = NULL;
+	unsigned long flags;
 
-#ifdef CONFIG_NUMA
-	if (crng_node_pool)
-		crng = crng_node_pool[numa_node_id()];
-	if (crng == NULL)
-#endif
-		crng = &primary_crng;
-	_extract_crng(crng, out);
+	if (!crng_pcpu_usable()) {
+		_extract_crng(&primary_crng, out);
+		return;
+	}
+
+	local_irq_save(flags);
+	crng_pcpu_block(crng_pcpu_get(), out);
+	local_irq_restore(flags);
+}
+
+/*
+ * Set up a private ChaCha20 state for bulk output.  Its key comes from
+ * the per-CPU CRNG, whose own key is replaced in the same critical
+ * section, so the output needs no further backtrack protection and the
+ * bulk of the work runs without interrupts disabled.
+ */
+static bool crng_make_state(__u32 state[16])
+{
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	struct crng_pcpu *pcrng;
+	unsigned long flags;
+
+	if (!crng_pcpu_usable())
+		return false;
+
+	local_irq_save(flags);
+	pcrng = crng_pcpu_get();
+	crng_pcpu_block(pcrng, tmp);
+	memcpy(&pcrng->state[4], tmp, CHACHA20_KEY_SIZE);
+	local_irq_restore(flags);
+
+	memcpy(&state[0], "expand 32-byte k", 16);
+	memcpy(&state[4], &tmp[CHACHA20_KEY_SIZE], CHACHA20_KEY_SIZE);
+	memset(&state[12], 0, 4 * sizeof(__u32));
+	memzero_explicit(tmp, sizeof(tmp));
+	return true;
 }
 
 /*
@@ -906,15 +1021,46 @@ static void _crng_backtrack_protect(struct crng_state *crng,
 
 static void crng_backtrack_protect(__u8 tmp[CHACHA20_BLOCK_SIZE], int used)
 {
-	struct crng_state *crng = NULL;
+	_crng_backtrack_protect(&primary_crng, tmp, used);
+}
 
-#ifdef CONFIG_NUMA
-	if (crng_node_pool)
-		crng = crng_node_pool[numa_node_id()];
-	if (crng == NULL)
-#endif
-		crng = &primary_crng;
-	_crng_backtrack_protect(crng, tmp, used);
+/* Blocks generated at a time for bulk reads, enough for 8-way SIMD. */
+#define CRNG_BULK_BLOCKS	8
+
+static ssize_t extract_crng_user_bulk(__u32 state[16], void __user *buf,
+				      size_t nbytes)
+{
+	__u8 tmp[CRNG_BULK_BLOCKS * CHACHA20_BLOCK_SIZE] __aligned(16);
+	int large_request = (nbytes > 256);
+	ssize_t ret = 0, i;
+
+	while (nbytes) {
+		if (large_request && need_resched()) {
+			if (signal_pending(current)) {
+				if (ret == 0)
+					ret = -ERESTARTSYS;
+				break;
+			}
+			schedule();
+		}
+
+		i = min_t(size_t, nbytes, sizeof(tmp));
+		chacha20_blocks(state, tmp,
+				DIV_ROUND_UP(i, CHACHA20_BLOCK_SIZE));
+		if (copy_to_user(buf, tmp, i)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		nbytes -= i;
+		buf += i;
+		ret += i;
+	}
+
+	memzero_explicit(tmp, sizeof(tmp));
+	memzero_explicit(state, 16 * sizeof(__u32));
+
+	return ret;
 }
 
 static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
@@ -922,6 +1068,10 @@ static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 	ssize_t ret = 0, i = CHACHA20_BLOCK_SIZE;
 	__u8 tmp[CHACHA20_BLOCK_SIZE];
 	int large_request = (nbytes > 256);
+	__u32 state[16];
+
+	if (crng_make_state(state))
+		return extract_crng_user_bulk(state, buf, nbytes);
 
 	while (nbytes) {
 		if (large_request && need_resched()) {
@@ -1508,9 +1658,25 @@ static void _warn_unseeded_randomness(const char *func_name, void *caller,
 static void _get_random_bytes(void *buf, int nbytes)
 {
 	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	__u32 state[16];
 
 	trace_get_random_bytes(nbytes, _RET_IP_);
 
+	if (crng_make_state(state)) {
+		while (nbytes >= CHACHA20_BLOCK_SIZE) {
+			chacha20_block(state, buf);
+			buf += CHACHA20_BLOCK_SIZE;
+			nbytes -= CHACHA20_BLOCK_SIZE;
+		}
+		if (nbytes > 0) {
+			chacha20_block(state, tmp);
+			memcpy(buf, tmp, nbytes);
+		}
+		memzero_explicit(state, sizeof(state));
+		memzero_explicit(tmp, sizeof(tmp));
+		return;
+	}
+
 	while (nbytes >= CHACHA20_BLOCK_SIZE) {
 		extract_crng(buf);
 		buf += CHACHA20_BLOCK_SIZE;
@@ -1682,28 +1848,12 @@ static void init_std_data(struct entropy_store *r)
  */
 static int rand_initialize(void)
 {
-#ifdef CONFIG_NUMA
-	int i;
-	struct crng_state *crng;
-	struct crng_state **pool;
-#endif
-
 	init_std_data(&input_pool);
 	init_std_data(&blocking_pool);
 	crng_initialize(&primary_crng);
 
-#ifdef CONFIG_NUMA
-	pool = kcalloc(nr_node_ids, sizeof(*pool), GFP_KERNEL|__GFP_NOFAIL);
-	for_each_online_node(i) {
-		crng = kmalloc_node(sizeof(struct crng_state),
-				    GFP_KERNEL | __GFP_NOFAIL, i);
-		spin_lock_init(&crng->lock);
-		crng_initialize(crng);
-		pool[i] = crng;
-	}
-	mb();
-	crng_node_pool = pool;
-#endif
+	/* The per-CPU CRNGs key themselves from primary_crng on first use. */
+	smp_store_release(&crng_pcpu_enabled, true);
 	return 0;
 }
 early_initcall(rand_initialize);
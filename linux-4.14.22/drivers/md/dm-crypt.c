@@ -50,6 +50,7 @@ struct convert_context {
 	struct bvec_iter iter_in;
 	struct bvec_iter iter_out;
 	sector_t cc_sector;
+	unsigned int tag_offset;
 	atomic_t cc_pending;
 	union {
 		struct skcipher_request *req;
@@ -73,6 +74,8 @@ struct dm_crypt_io {
 	atomic_t io_pending;
 	blk_status_t error;
 	sector_t sector;
+	u64 start_ns;
+	bool offload;
 
 	struct rb_node rb_node;
 } CRYPTO_MINALIGN_ATTR;
@@ -125,13 +128,25 @@ struct iv_tcw_private {
  * and encrypts / decrypts at the same time.
  */
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
-	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD };
+	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD,
+	     DM_CRYPT_NO_READ_WORKQUEUE, DM_CRYPT_NO_WRITE_WORKQUEUE };
 
 enum cipher_flags {
 	CRYPT_MODE_INTEGRITY_AEAD,	/* Use authenticated mode for cihper */
 	CRYPT_IV_LARGE_SECTORS,		/* Calculate IV from sector_size, not 512B sectors */
 };
 
+/*
+ * Per-CPU I/O statistics, reported by the INFO status.
+ */
+struct crypt_stats {
+	u64 ios[2];
+	u64 sectors[2];
+	u64 nsecs[2];
+	u64 inline_ios;
+	u64 queued_ios;
+};
+
 /*
  * The fields in here must be read only after initialization.
  */
@@ -158,6 +173,10 @@ struct crypt_config {
 	wait_queue_head_t write_thread_wait;
 	struct rb_root write_tree;
 
+	/* larger bios are split and spread over the crypt workqueue */
+	unsigned int max_inline_sectors;
+	struct crypt_stats __percpu *stats;
+
 	char *cipher;
 	char *cipher_string;
 	char *cipher_auth;
@@ -998,6 +1017,7 @@ static void crypt_convert_init(struct crypt_config *cc,
 	if (bio_out)
 		ctx->iter_out = bio_out->bi_iter;
 	ctx->cc_sector = sector + cc->iv_offset;
+	ctx->tag_offset = 0;
 	init_completion(&ctx->restart);
 }
 
@@ -1231,13 +1251,21 @@ static int crypt_convert_block_skcipher(struct crypt_config *cc,
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
 
-static void crypt_alloc_req_skcipher(struct crypt_config *cc,
-				     struct convert_context *ctx)
+/*
+ * Decryption may run from bio completion (softirq) context, see
+ * kcryptd_queue_crypt(); neither allocation nor the cipher may sleep there.
+ */
+static int crypt_alloc_req_skcipher(struct crypt_config *cc,
+				    struct convert_context *ctx)
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
 
-	if (!ctx->r.req)
-		ctx->r.req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!ctx->r.req) {
+		ctx->r.req = mempool_alloc(cc->req_pool,
+				in_interrupt() ? GFP_ATOMIC : GFP_NOIO);
+		if (!ctx->r.req)
+			return -ENOMEM;
+	}
 
 	skcipher_request_set_tfm(ctx->r.req, cc->cipher_tfm.tfms[key_index]);
 
@@ -1246,15 +1274,22 @@ static void crypt_alloc_req_skcipher(struct crypt_config *cc,
 	 * requests if driver request queue is full.
 	 */
 	skcipher_request_set_callback(ctx->r.req,
-	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+	    CRYPTO_TFM_REQ_MAY_BACKLOG |
+	    (in_interrupt() ? 0 : CRYPTO_TFM_REQ_MAY_SLEEP),
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req));
+
+	return 0;
 }
 
-static void crypt_alloc_req_aead(struct crypt_config *cc,
-				 struct convert_context *ctx)
+static int crypt_alloc_req_aead(struct crypt_config *cc,
+				struct convert_context *ctx)
 {
-	if (!ctx->r.req_aead)
-		ctx->r.req_aead = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!ctx->r.req_aead) {
+		ctx->r.req_aead = mempool_alloc(cc->req_pool,
+				in_interrupt() ? GFP_ATOMIC : GFP_NOIO);
+		if (!ctx->r.req_aead)
+			return -ENOMEM;
+	}
 
 	aead_request_set_tfm(ctx->r.req_aead, cc->cipher_tfm.tfms_aead[0]);
 
@@ -1263,17 +1298,20 @@ static void crypt_alloc_req_aead(struct crypt_config *cc,
 	 * requests if driver request queue is full.
 	 */
 	aead_request_set_callback(ctx->r.req_aead,
-	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+	    CRYPTO_TFM_REQ_MAY_BACKLOG |
+	    (in_interrupt() ? 0 : CRYPTO_TFM_REQ_MAY_SLEEP),
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req_aead));
+
+	return 0;
 }
 
-static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+static int crypt_alloc_req(struct crypt_config *cc,
+			   struct convert_context *ctx)
 {
 	if (crypt_integrity_aead(cc))
-		crypt_alloc_req_aead(cc, ctx);
+		return crypt_alloc_req_aead(cc, ctx);
 	else
-		crypt_alloc_req_skcipher(cc, ctx);
+		return crypt_alloc_req_skcipher(cc, ctx);
 }
 
 static void crypt_free_req_skcipher(struct crypt_config *cc,
@@ -1304,25 +1342,34 @@ static void crypt_free_req(struct crypt_config *cc, void *req, struct bio *base_
 
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
+ *
+ * When called in interrupt context, BLK_STS_RESOURCE is returned if the
+ * conversion would have to sleep; the caller then continues it from the
+ * crypt workqueue without resetting cc_pending.
  */
 static blk_status_t crypt_convert(struct crypt_config *cc,
-			 struct convert_context *ctx)
+			 struct convert_context *ctx, bool reset_pending)
 {
-	unsigned int tag_offset = 0;
 	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
 	int r;
 
-	atomic_set(&ctx->cc_pending, 1);
+	if (reset_pending)
+		atomic_set(&ctx->cc_pending, 1);
 
 	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
 
-		crypt_alloc_req(cc, ctx);
+		r = crypt_alloc_req(cc, ctx);
+		if (r) {
+			complete(&ctx->restart);
+			return BLK_STS_RESOURCE;
+		}
+
 		atomic_inc(&ctx->cc_pending);
 
 		if (crypt_integrity_aead(cc))
-			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead, tag_offset);
+			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead, ctx->tag_offset);
 		else
-			r = crypt_convert_block_skcipher(cc, ctx, ctx->r.req, tag_offset);
+			r = crypt_convert_block_skcipher(cc, ctx, ctx->r.req, ctx->tag_offset);
 
 		switch (r) {
 		/*
@@ -1330,7 +1377,20 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		 * but the driver request queue is full, let's wait.
 		 */
 		case -EBUSY:
-			wait_for_completion(&ctx->restart);
+			if (in_interrupt()) {
+				if (!try_wait_for_completion(&ctx->restart)) {
+					/*
+					 * Can't wait here, let the workqueue
+					 * wait and carry on from the next
+					 * sector.
+					 */
+					ctx->r.req = NULL;
+					ctx->cc_sector += sector_step;
+					ctx->tag_offset++;
+					return BLK_STS_RESOURCE;
+				}
+			} else
+				wait_for_completion(&ctx->restart);
 			reinit_completion(&ctx->restart);
 			/* fall through */
 		/*
@@ -1340,7 +1400,7 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		case -EINPROGRESS:
 			ctx->r.req = NULL;
 			ctx->cc_sector += sector_step;
-			tag_offset++;
+			ctx->tag_offset++;
 			continue;
 		/*
 		 * The request was already processed (synchronously).
@@ -1348,8 +1408,9 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		case 0:
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector += sector_step;
-			tag_offset++;
-			cond_resched();
+			ctx->tag_offset++;
+			if (!in_interrupt())
+				cond_resched();
 			continue;
 		/*
 		 * There was a data integrity error.
@@ -1460,6 +1521,8 @@ static void crypt_io_init(struct dm_crypt_io *io, struct crypt_config *cc,
 	io->ctx.r.req = NULL;
 	io->integrity_metadata = NULL;
 	io->integrity_metadata_from_pool = false;
+	io->start_ns = ktime_get_ns();
+	io->offload = false;
 	atomic_set(&io->io_pending, 0);
 }
 
@@ -1477,10 +1540,16 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
 	struct crypt_config *cc = io->cc;
 	struct bio *base_bio = io->base_bio;
 	blk_status_t error = io->error;
+	int rw;
 
 	if (!atomic_dec_and_test(&io->io_pending))
 		return;
 
+	rw = bio_data_dir(base_bio);
+	this_cpu_inc(cc->stats->ios[rw]);
+	this_cpu_add(cc->stats->sectors[rw], bio_sectors(base_bio));
+	this_cpu_add(cc->stats->nsecs[rw], ktime_get_ns() - io->start_ns);
+
 	if (io->ctx.r.req)
 		crypt_free_req(cc, io->ctx.r.req, base_bio);
 
@@ -1681,7 +1750,8 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_iter.bi_sector = cc->start + io->sector;
 
-	if (likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+	if (likely(!async) && (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags) ||
+			       test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))) {
 		generic_make_request(clone);
 		return;
 	}
@@ -1730,7 +1800,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	sector += bio_sectors(clone);
 
 	crypt_inc_pending(io);
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, true);
 	if (r)
 		io->error = r;
 	crypt_finished = atomic_dec_and_test(&io->ctx.cc_pending);
@@ -1750,6 +1820,25 @@ static void kcryptd_crypt_read_done(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
+static void kcryptd_crypt_read_continue(struct work_struct *work)
+{
+	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
+	struct crypt_config *cc = io->cc;
+	blk_status_t r;
+
+	wait_for_completion(&io->ctx.restart);
+	reinit_completion(&io->ctx.restart);
+
+	r = crypt_convert(cc, &io->ctx, false);
+	if (r)
+		io->error = r;
+
+	if (atomic_dec_and_test(&io->ctx.cc_pending))
+		kcryptd_crypt_read_done(io);
+
+	crypt_dec_pending(io);
+}
+
 static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
@@ -1760,7 +1849,16 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
 
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, true);
+	/*
+	 * Decrypting from bio completion and the conversion would have had
+	 * to sleep: carry on from the workqueue.
+	 */
+	if (r == BLK_STS_RESOURCE) {
+		INIT_WORK(&io->work, kcryptd_crypt_read_continue);
+		queue_work(cc->crypt_queue, &io->work);
+		return;
+	}
 	if (r)
 		io->error = r;
 
@@ -1819,10 +1917,44 @@ static void kcryptd_crypt(struct work_struct *work)
 		kcryptd_crypt_write_convert(io);
 }
 
+/*
+ * With no_read_workqueue reads are decrypted right in the bio completion
+ * and with no_write_workqueue writes are encrypted in the context of the
+ * submitter, and submitted from it too unless the cipher is asynchronous,
+ * bypassing the dmcrypt_write thread.  This saves context switches per I/O
+ * where the cipher is fast enough for it not to matter which CPU does the
+ * work.  Bios split by crypt_map() for exceeding max_inline_sectors still
+ * go through the workqueue so that they are spread over the CPUs.
+ */
+static bool kcryptd_crypt_inline(struct dm_crypt_io *io)
+{
+	struct crypt_config *cc = io->cc;
+
+	if (io->offload)
+		return false;
+
+	if (bio_data_dir(io->base_bio) == WRITE)
+		return test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+
+	/*
+	 * skcipher walks refuse to run in hard IRQ context, and some
+	 * completions are run with interrupts disabled.
+	 */
+	return test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags) &&
+	       !in_irq() && !irqs_disabled();
+}
+
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
 
+	if (kcryptd_crypt_inline(io)) {
+		this_cpu_inc(cc->stats->inline_ios);
+		kcryptd_crypt(&io->work);
+		return;
+	}
+
+	this_cpu_inc(cc->stats->queued_ios);
 	INIT_WORK(&io->work, kcryptd_crypt);
 	queue_work(cc->crypt_queue, &io->work);
 }
@@ -2173,6 +2305,8 @@ static void crypt_dtr(struct dm_target *ti)
 	if (cc->crypt_queue)
 		destroy_workqueue(cc->crypt_queue);
 
+	free_percpu(cc->stats);
+
 	crypt_free_tfms(cc);
 
 	if (cc->bs)
@@ -2537,7 +2671,7 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 	struct crypt_config *cc = ti->private;
 	struct dm_arg_set as;
 	static const struct dm_arg _args[] = {
-		{0, 6, "Invalid number of feature args"},
+		{0, 9, "Invalid number of feature args"},
 	};
 	unsigned int opt_params, val;
 	const char *opt_string, *sval;
@@ -2567,7 +2701,16 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 
 		else if (!strcasecmp(opt_string, "submit_from_crypt_cpus"))
 			set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
-		else if (sscanf(opt_string, "integrity:%u:", &val) == 1) {
+		else if (!strcasecmp(opt_string, "no_read_workqueue"))
+			set_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		else if (!strcasecmp(opt_string, "no_write_workqueue"))
+			set_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+		else if (sscanf(opt_string, "max_inline_sectors:%u%c", &cc->max_inline_sectors, &dummy) == 1) {
+			if (!cc->max_inline_sectors) {
+				ti->error = "Invalid feature value for max_inline_sectors";
+				return -EINVAL;
+			}
+		} else if (sscanf(opt_string, "integrity:%u:", &val) == 1) {
 			if (val == 0 || val > MAX_TAG_SIZE) {
 				ti->error = "Invalid integrity arguments";
 				return -EINVAL;
@@ -2650,6 +2793,20 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 			goto bad;
 	}
 
+	if (cc->max_inline_sectors &
+	    ((cc->sector_size >> SECTOR_SHIFT) - 1)) {
+		ti->error = "max_inline_sectors is not a multiple of sector_size";
+		ret = -EINVAL;
+		goto bad;
+	}
+
+	cc->stats = alloc_percpu(struct crypt_stats);
+	if (!cc->stats) {
+		ti->error = "Cannot allocate statistics";
+		ret = -ENOMEM;
+		goto bad;
+	}
+
 	ret = crypt_ctr_cipher(ti, argv[0], argv[1]);
 	if (ret < 0)
 		goto bad;
@@ -2829,7 +2986,19 @@ static int crypt_map(struct dm_target *ti, struct bio *bio)
 		return DM_MAPIO_KILL;
 
 	io = dm_per_bio_data(bio, cc->per_bio_data_size);
-	crypt_io_init(io, cc, bio, dm_target_offset(ti, bio->bi_iter.bi_sector));
+
+	/*
+	 * Rather than converting a large bio inline on one CPU, split it
+	 * and let the crypt workqueue spread the pieces.
+	 */
+	if (cc->max_inline_sectors && bio_sectors(bio) > cc->max_inline_sectors &&
+	    test_bit(bio_data_dir(bio) == READ ? DM_CRYPT_NO_READ_WORKQUEUE :
+		     DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags)) {
+		dm_accept_partial_bio(bio, cc->max_inline_sectors);
+		crypt_io_init(io, cc, bio, dm_target_offset(ti, bio->bi_iter.bi_sector));
+		io->offload = true;
+	} else
+		crypt_io_init(io, cc, bio, dm_target_offset(ti, bio->bi_iter.bi_sector));
 
 	if (cc->on_disk_tag_size) {
 		unsigned tag_len = cc->on_disk_tag_size * (bio_sectors(bio) >> cc->sector_shift);
@@ -2858,16 +3027,43 @@ static int crypt_map(struct dm_target *ti, struct bio *bio)
 	return DM_MAPIO_SUBMITTED;
 }
 
+/*
+ * INFO status:
+ *   <reads> <read sectors> <average read latency in us>
+ *   <writes> <written sectors> <average write latency in us>
+ *   <bios converted inline> <bios converted by the workqueue>
+ */
 static void crypt_status(struct dm_target *ti, status_type_t type,
 			 unsigned status_flags, char *result, unsigned maxlen)
 {
 	struct crypt_config *cc = ti->private;
+	struct crypt_stats sum;
 	unsigned i, sz = 0;
-	int num_feature_args = 0;
+	int cpu, rw, num_feature_args = 0;
 
 	switch (type) {
 	case STATUSTYPE_INFO:
-		result[0] = '\0';
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			struct crypt_stats *stats = per_cpu_ptr(cc->stats, cpu);
+
+			for (rw = READ; rw <= WRITE; rw++) {
+				sum.ios[rw] += stats->ios[rw];
+				sum.sectors[rw] += stats->sectors[rw];
+				sum.nsecs[rw] += stats->nsecs[rw];
+			}
+			sum.inline_ios += stats->inline_ios;
+			sum.queued_ios += stats->queued_ios;
+		}
+
+		for (rw = READ; rw <= WRITE; rw++)
+			DMEMIT("%llu %llu %llu ",
+			       (unsigned long long)sum.ios[rw],
+			       (unsigned long long)sum.sectors[rw],
+			       (unsigned long long)(sum.ios[rw] ?
+				div64_u64(sum.nsecs[rw], sum.ios[rw] * NSEC_PER_USEC) : 0));
+		DMEMIT("%llu %llu", (unsigned long long)sum.inline_ios,
+		       (unsigned long long)sum.queued_ios);
 		break;
 
 	case STATUSTYPE_TABLE:
@@ -2888,6 +3084,9 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		num_feature_args += !!ti->num_discard_bios;
 		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+		num_feature_args += !!cc->max_inline_sectors;
 		num_feature_args += cc->sector_size != (1 << SECTOR_SHIFT);
 		num_feature_args += test_bit(CRYPT_IV_LARGE_SECTORS, &cc->cipher_flags);
 		if (cc->on_disk_tag_size)
@@ -2900,6 +3099,12 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 				DMEMIT(" same_cpu_crypt");
 			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
 				DMEMIT(" submit_from_crypt_cpus");
+			if (test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_read_workqueue");
+			if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_write_workqueue");
+			if (cc->max_inline_sectors)
+				DMEMIT(" max_inline_sectors:%u", cc->max_inline_sectors);
 			if (cc->on_disk_tag_size)
 				DMEMIT(" integrity:%u:%s", cc->on_disk_tag_size, cc->cipher_auth);
 			if (cc->sector_size != (1 << SECTOR_SHIFT))
@@ -3017,7 +3222,7 @@ static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 18, 1},
+	.version = {1, 19, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -0,0 +1,737 @@
+/*
+ * A read-only target that records a cryptographic digest of every chunk
+ * read through it, so that imaging a disk also yields evidence of what
+ * was read, in the same pass.
+ *
+ * Reads are passed through to the underlying device unchanged. When a
+ * read covering a whole chunk completes, the data is hashed on an unbound
+ * workqueue, so that chunks are hashed in parallel on all CPUs, before the
+ * bio is completed. The first digest of a chunk is kept in a per-chunk
+ * digest map; reading the chunk again is checked against it and any
+ * difference is counted and logged. Reads that only cover part of a chunk,
+ * such as buffered reads and readahead, are passed through and counted;
+ * if their chunk has no digest yet, the whole chunk is read again from the
+ * underlying device in the background and hashed, so that the chunk is
+ * still recorded. Such a chunk is hashed only once.
+ *
+ * The digest map is exported in debugfs, as
+ * dm-digest/<device>-<start>-<instance>, with one "<chunk> <digest>" line
+ * per hashed chunk. The instance number tells apart the targets of
+ * successive table loads.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched/mm.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/device-mapper.h>
+#include <linux/dm-io.h>
+#include <crypto/hash.h>
+
+#define DM_MSG_PREFIX			"digest"
+
+#define DM_DIGEST_DEFAULT_ALG		"sha256"
+#define DM_DIGEST_MAX_DIGEST_SIZE	64
+
+struct dm_digest {
+	struct dm_target *ti;
+	struct dm_dev *dev;
+	sector_t start;
+	unsigned chunk_sectors;
+	unsigned char chunk_bits;	/* log2(chunk_sectors) */
+	sector_t nr_chunks;
+
+	char *alg_name;
+	struct crypto_ahash *tfm;
+	unsigned digest_size;
+	unsigned ahash_reqsize;
+
+	spinlock_t lock;		/* protects digests, hashed and reading */
+	u8 *digests;			/* nr_chunks * digest_size */
+	unsigned long *hashed;		/* chunks with a recorded digest */
+	unsigned long *reading;		/* chunks being read whole for hashing */
+	atomic64_t nr_hashed;
+	atomic64_t mismatches;
+	atomic64_t partial_reads;
+
+	struct workqueue_struct *wq;
+	struct dm_io_client *io_client;
+	struct dentry *debugfs;
+};
+
+struct dm_digest_io {
+	struct dm_digest *dd;
+	bio_end_io_t *orig_bi_end_io;
+	struct bvec_iter iter;
+	sector_t chunk;
+	struct work_struct work;
+
+	/*
+	 * Followed by the ahash request of dd->ahash_reqsize bytes and a
+	 * digest_size buffer for the result.
+	 */
+};
+
+struct dm_digest_result {
+	struct completion completion;
+	int err;
+};
+
+static struct dentry *dm_digest_debugfs_root;
+static atomic_t dm_digest_instances = ATOMIC_INIT(0);
+
+static struct ahash_request *io_hash_req(struct dm_digest *dd,
+					 struct dm_digest_io *io)
+{
+	return (struct ahash_request *)(io + 1);
+}
+
+static u8 *io_digest(struct dm_digest *dd, struct dm_digest_io *io)
+{
+	return (u8 *)(io + 1) + dd->ahash_reqsize;
+}
+
+static u8 *chunk_digest(struct dm_digest *dd, sector_t chunk)
+{
+	return dd->digests + (size_t)chunk * dd->digest_size;
+}
+
+static void digest_op_done(struct crypto_async_request *base, int err)
+{
+	struct dm_digest_result *res = base->data;
+
+	if (err == -EINPROGRESS)
+		return;
+
+	res->err = err;
+	complete(&res->completion);
+}
+
+static int digest_complete_op(struct dm_digest_result *res, int ret)
+{
+	if (ret == -EINPROGRESS || ret == -EBUSY) {
+		wait_for_completion(&res->completion);
+		ret = res->err;
+		reinit_completion(&res->completion);
+	}
+
+	return ret;
+}
+
+/*
+ * Hash the data of a completed read. The bio's own iterator has been
+ * advanced by the lower device, so walk the copy saved at map time.
+ */
+static int digest_hash_bio(struct dm_digest *dd, struct dm_digest_io *io,
+			   struct bio *bio)
+{
+	struct ahash_request *req = io_hash_req(dd, io);
+	struct dm_digest_result res;
+	struct bvec_iter iter = io->iter;
+	struct scatterlist sg;
+	int r;
+
+	ahash_request_set_tfm(req, dd->tfm);
+	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
+				   CRYPTO_TFM_REQ_MAY_BACKLOG,
+				   digest_op_done, &res);
+	init_completion(&res.completion);
+
+	r = digest_complete_op(&res, crypto_ahash_init(req));
+	if (unlikely(r < 0))
+		return r;
+
+	while (iter.bi_size) {
+		struct bio_vec bv = bio_iter_iovec(bio, iter);
+
+		sg_init_table(&sg, 1);
+		sg_set_page(&sg, bv.bv_page, bv.bv_len, bv.bv_offset);
+		ahash_request_set_crypt(req, &sg, NULL, bv.bv_len);
+
+		r = digest_complete_op(&res, crypto_ahash_update(req));
+		if (unlikely(r < 0))
+			return r;
+
+		bio_advance_iter(bio, &iter, bv.bv_len);
+	}
+
+	ahash_request_set_crypt(req, NULL, io_digest(dd, io), 0);
+
+	return digest_complete_op(&res, crypto_ahash_final(req));
+}
+
+/*
+ * Hash a whole chunk read into a vmalloc'ed buffer.
+ */
+static int digest_hash_buf(struct dm_digest *dd, struct dm_digest_io *io,
+			   u8 *buf, unsigned len)
+{
+	struct ahash_request *req = io_hash_req(dd, io);
+	struct dm_digest_result res;
+	struct scatterlist sg;
+	unsigned done, n;
+	int r;
+
+	ahash_request_set_tfm(req, dd->tfm);
+	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
+				   CRYPTO_TFM_REQ_MAY_BACKLOG,
+				   digest_op_done, &res);
+	init_completion(&res.completion);
+
+	r = digest_complete_op(&res, crypto_ahash_init(req));
+	if (unlikely(r < 0))
+		return r;
+
+	for (done = 0; done < len; done += n) {
+		n = min_t(unsigned, len - done, PAGE_SIZE);
+
+		sg_init_table(&sg, 1);
+		sg_set_page(&sg, vmalloc_to_page(buf + done), n, 0);
+		ahash_request_set_crypt(req, &sg, NULL, n);
+
+		r = digest_complete_op(&res, crypto_ahash_update(req));
+		if (unlikely(r < 0))
+			return r;
+	}
+
+	ahash_request_set_crypt(req, NULL, io_digest(dd, io), 0);
+
+	return digest_complete_op(&res, crypto_ahash_final(req));
+}
+
+static void digest_record(struct dm_digest *dd, struct dm_digest_io *io)
+{
+	u8 *digest = chunk_digest(dd, io->chunk);
+	bool mismatch = false;
+
+	spin_lock(&dd->lock);
+	if (!test_bit(io->chunk, dd->hashed)) {
+		memcpy(digest, io_digest(dd, io), dd->digest_size);
+		__set_bit(io->chunk, dd->hashed);
+		atomic64_inc(&dd->nr_hashed);
+	} else if (memcmp(digest, io_digest(dd, io), dd->digest_size)) {
+		mismatch = true;
+	}
+	spin_unlock(&dd->lock);
+
+	if (unlikely(mismatch)) {
+		atomic64_inc(&dd->mismatches);
+		DMERR_LIMIT("%s: chunk %llu read back with a different digest",
+			    dd->dev->name, (unsigned long long)io->chunk);
+	}
+}
+
+static void digest_finish_io(struct dm_digest_io *io, blk_status_t status)
+{
+	struct bio *bio = dm_bio_from_per_bio_data(io,
+						   io->dd->ti->per_io_data_size);
+
+	bio->bi_end_io = io->orig_bi_end_io;
+	bio->bi_status = status;
+
+	bio_endio(bio);
+}
+
+static void digest_work(struct work_struct *w)
+{
+	struct dm_digest_io *io = container_of(w, struct dm_digest_io, work);
+	struct dm_digest *dd = io->dd;
+	struct bio *bio = dm_bio_from_per_bio_data(io,
+						   dd->ti->per_io_data_size);
+	int r;
+
+	r = digest_hash_bio(dd, io, bio);
+	if (unlikely(r < 0)) {
+		DMERR_LIMIT("%s: cannot hash chunk %llu: %d", dd->dev->name,
+			    (unsigned long long)io->chunk, r);
+		digest_finish_io(io, BLK_STS_IOERR);
+		return;
+	}
+
+	digest_record(dd, io);
+	digest_finish_io(io, BLK_STS_OK);
+}
+
+static void digest_end_io(struct bio *bio)
+{
+	struct dm_digest_io *io = bio->bi_private;
+
+	if (bio->bi_status) {
+		digest_finish_io(io, bio->bi_status);
+		return;
+	}
+
+	INIT_WORK(&io->work, digest_work);
+	queue_work(io->dd->wq, &io->work);
+}
+
+/*
+ * Read a chunk that was only partially read through the target in whole,
+ * and record its digest.
+ */
+static void digest_chunk_work(struct work_struct *w)
+{
+	struct dm_digest_io *io = container_of(w, struct dm_digest_io, work);
+	struct dm_digest *dd = io->dd;
+	sector_t offset = io->chunk << dd->chunk_bits;
+	struct dm_io_region region = {
+		.bdev	= dd->dev->bdev,
+		.sector	= dd->start + offset,
+		.count	= min_t(sector_t, dd->chunk_sectors,
+				dd->ti->len - offset),
+	};
+	struct dm_io_request req = {
+		.bi_op		= REQ_OP_READ,
+		.bi_op_flags	= 0,
+		.mem.type	= DM_IO_VMA,
+		.notify.fn	= NULL,
+		.client		= dd->io_client,
+	};
+	unsigned noio_flag;
+	u8 *buf;
+	int r;
+
+	noio_flag = memalloc_noio_save();
+	buf = vmalloc(region.count << SECTOR_SHIFT);
+	memalloc_noio_restore(noio_flag);
+	if (!buf) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	req.mem.ptr.vma = buf;
+	r = dm_io(&req, 1, &region, NULL);
+	if (!r)
+		r = digest_hash_buf(dd, io, buf, region.count << SECTOR_SHIFT);
+	if (!r)
+		digest_record(dd, io);
+
+	vfree(buf);
+out:
+	if (unlikely(r < 0))
+		DMERR_LIMIT("%s: cannot read chunk %llu for hashing: %d",
+			    dd->dev->name, (unsigned long long)io->chunk, r);
+
+	/* On failure, a later partial read of the chunk retries it */
+	spin_lock(&dd->lock);
+	__clear_bit(io->chunk, dd->reading);
+	spin_unlock(&dd->lock);
+
+	kfree(io);
+}
+
+/*
+ * A read covered only part of a chunk, so its data cannot give the digest
+ * of the chunk. Unless the chunk is already recorded or being read, queue
+ * a read of the whole chunk to hash it.
+ */
+static void digest_partial_read(struct dm_digest *dd, sector_t chunk)
+{
+	struct dm_digest_io *io;
+	bool queue = false;
+
+	atomic64_inc(&dd->partial_reads);
+
+	spin_lock(&dd->lock);
+	if (!test_bit(chunk, dd->hashed) && !test_bit(chunk, dd->reading)) {
+		__set_bit(chunk, dd->reading);
+		queue = true;
+	}
+	spin_unlock(&dd->lock);
+
+	if (!queue)
+		return;
+
+	io = kmalloc(dd->ti->per_io_data_size, GFP_NOIO);
+	if (unlikely(!io)) {
+		DMERR_LIMIT("%s: cannot queue hashing of partially read chunk %llu",
+			    dd->dev->name, (unsigned long long)chunk);
+		spin_lock(&dd->lock);
+		__clear_bit(chunk, dd->reading);
+		spin_unlock(&dd->lock);
+		return;
+	}
+
+	io->dd = dd;
+	io->chunk = chunk;
+	INIT_WORK(&io->work, digest_chunk_work);
+	queue_work(dd->wq, &io->work);
+}
+
+static int digest_map(struct dm_target *ti, struct bio *bio)
+{
+	struct dm_digest *dd = ti->private;
+	sector_t offset = dm_target_offset(ti, bio->bi_iter.bi_sector);
+	struct dm_digest_io *io;
+
+	if (bio_data_dir(bio) == WRITE)
+		return DM_MAPIO_KILL;
+
+	bio_set_dev(bio, dd->dev->bdev);
+	bio->bi_iter.bi_sector = dd->start + offset;
+
+	/*
+	 * max_io_len keeps bios within a chunk, so only reads starting at a
+	 * chunk boundary can cover one. The last chunk may be short. Partial
+	 * reads are passed through, and their chunk is hashed separately.
+	 */
+	if ((offset & (dd->chunk_sectors - 1)) ||
+	    bio_sectors(bio) != min_t(sector_t, dd->chunk_sectors,
+				      ti->len - offset)) {
+		if (bio_sectors(bio))
+			digest_partial_read(dd, offset >> dd->chunk_bits);
+		return DM_MAPIO_REMAPPED;
+	}
+
+	io = dm_per_bio_data(bio, ti->per_io_data_size);
+	io->dd = dd;
+	io->orig_bi_end_io = bio->bi_end_io;
+	io->chunk = offset >> dd->chunk_bits;
+
+	bio->bi_end_io = digest_end_io;
+	bio->bi_private = io;
+	io->iter = bio->bi_iter;
+
+	generic_make_request(bio);
+
+	return DM_MAPIO_SUBMITTED;
+}
+
+/*
+ * Status: <hashed chunks>/<total chunks> <mismatches> <partial reads>
+ */
+static void digest_status(struct dm_target *ti, status_type_t type,
+			  unsigned status_flags, char *result, unsigned maxlen)
+{
+	struct dm_digest *dd = ti->private;
+	unsigned sz = 0;
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		DMEMIT("%llu/%llu %llu %llu",
+		       (unsigned long long)atomic64_read(&dd->nr_hashed),
+		       (unsigned long long)dd->nr_chunks,
+		       (unsigned long long)atomic64_read(&dd->mismatches),
+		       (unsigned long long)atomic64_read(&dd->partial_reads));
+		break;
+	case STATUSTYPE_TABLE:
+		DMEMIT("%s %llu %u %s", dd->dev->name,
+		       (unsigned long long)dd->start, dd->chunk_sectors,
+		       dd->alg_name);
+		break;
+	}
+}
+
+/*
+ * No whole-chunk read may be issued to the underlying device once the
+ * target is suspended.
+ */
+static void digest_postsuspend(struct dm_target *ti)
+{
+	struct dm_digest *dd = ti->private;
+
+	flush_workqueue(dd->wq);
+}
+
+static int digest_prepare_ioctl(struct dm_target *ti,
+				struct block_device **bdev, fmode_t *mode)
+{
+	struct dm_digest *dd = ti->private;
+
+	*bdev = dd->dev->bdev;
+
+	if (dd->start ||
+	    ti->len != i_size_read(dd->dev->bdev->bd_inode) >> SECTOR_SHIFT)
+		return 1;
+	return 0;
+}
+
+static int digest_iterate_devices(struct dm_target *ti,
+				  iterate_devices_callout_fn fn, void *data)
+{
+	struct dm_digest *dd = ti->private;
+
+	return fn(ti, dd->dev, dd->start, ti->len, data);
+}
+
+static void *digest_seq_next_chunk(struct dm_digest *dd, loff_t *pos)
+{
+	unsigned long chunk;
+
+	if (*pos >= dd->nr_chunks)
+		return NULL;
+
+	chunk = find_next_bit(dd->hashed, dd->nr_chunks, *pos);
+	if (chunk >= dd->nr_chunks)
+		return NULL;
+
+	*pos = chunk;
+	return pos;
+}
+
+static void *digest_seq_start(struct seq_file *m, loff_t *pos)
+{
+	return digest_seq_next_chunk(m->private, pos);
+}
+
+static void *digest_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return digest_seq_next_chunk(m->private, pos);
+}
+
+static void digest_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int digest_seq_show(struct seq_file *m, void *v)
+{
+	struct dm_digest *dd = m->private;
+	sector_t chunk = *(loff_t *)v;
+
+	/* A recorded digest never changes, no need for dd->lock */
+	seq_printf(m, "%llu %*phN\n", (unsigned long long)chunk,
+		   dd->digest_size, chunk_digest(dd, chunk));
+	return 0;
+}
+
+static const struct seq_operations digest_seq_ops = {
+	.start	= digest_seq_start,
+	.next	= digest_seq_next,
+	.stop	= digest_seq_stop,
+	.show	= digest_seq_show,
+};
+
+static int digest_debugfs_open(struct inode *inode, struct file *file)
+{
+	int r;
+
+	r = seq_open(file, &digest_seq_ops);
+	if (!r)
+		((struct seq_file *)file->private_data)->private =
+			inode->i_private;
+	return r;
+}
+
+static const struct file_operations digest_debugfs_fops = {
+	.owner		= THIS_MODULE,
+	.open		= digest_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+static void digest_dtr(struct dm_target *ti)
+{
+	struct dm_digest *dd = ti->private;
+
+	debugfs_remove(dd->debugfs);
+
+	if (dd->wq)
+		destroy_workqueue(dd->wq);
+
+	if (!IS_ERR_OR_NULL(dd->io_client))
+		dm_io_client_destroy(dd->io_client);
+
+	vfree(dd->reading);
+	vfree(dd->hashed);
+	vfree(dd->digests);
+
+	if (dd->tfm)
+		crypto_free_ahash(dd->tfm);
+
+	kfree(dd->alg_name);
+
+	if (dd->dev)
+		dm_put_device(ti, dd->dev);
+
+	kfree(dd);
+}
+
+/*
+ * Construct a digest mapping:
+ * <dev_path> <offset> <chunk_sectors> [<hash_alg>]
+ *
+ * chunk_sectors must be a power of two of at least 8. The digest map takes
+ * digest size bytes per chunk, 32MB per TB for sha256 and 1MB chunks.
+ */
+static int digest_ctr(struct dm_target *ti, unsigned argc, char **argv)
+{
+	struct dm_digest *dd;
+	unsigned long long tmp;
+	unsigned chunk_sectors;
+	char name[64];
+	char dummy;
+	int r;
+
+	if (argc != 3 && argc != 4) {
+		ti->error = "Invalid argument count";
+		return -EINVAL;
+	}
+
+	dd = kzalloc(sizeof(*dd), GFP_KERNEL);
+	if (!dd) {
+		ti->error = "Cannot allocate digest structure";
+		return -ENOMEM;
+	}
+	ti->private = dd;
+	dd->ti = ti;
+	spin_lock_init(&dd->lock);
+	atomic64_set(&dd->nr_hashed, 0);
+	atomic64_set(&dd->mismatches, 0);
+	atomic64_set(&dd->partial_reads, 0);
+
+	if (dm_table_get_mode(ti->table) & ~FMODE_READ) {
+		ti->error = "Device must be readonly";
+		r = -EINVAL;
+		goto bad;
+	}
+
+	r = dm_get_device(ti, argv[0], FMODE_READ, &dd->dev);
+	if (r) {
+		ti->error = "Device lookup failed";
+		goto bad;
+	}
+
+	r = -EINVAL;
+	if (sscanf(argv[1], "%llu%c", &tmp, &dummy) != 1 ||
+	    tmp != (sector_t)tmp) {
+		ti->error = "Invalid device sector";
+		goto bad;
+	}
+	dd->start = tmp;
+
+	if (sscanf(argv[2], "%u%c", &chunk_sectors, &dummy) != 1 ||
+	    chunk_sectors < 8 || !is_power_of_2(chunk_sectors)) {
+		ti->error = "Invalid chunk size";
+		goto bad;
+	}
+	dd->chunk_sectors = chunk_sectors;
+	dd->chunk_bits = __ffs(chunk_sectors);
+	dd->nr_chunks = DIV_ROUND_UP_SECTOR_T(ti->len, chunk_sectors);
+
+	dd->alg_name = kstrdup(argc == 4 ? argv[3] : DM_DIGEST_DEFAULT_ALG,
+			       GFP_KERNEL);
+	if (!dd->alg_name) {
+		ti->error = "Cannot allocate algorithm name";
+		r = -ENOMEM;
+		goto bad;
+	}
+
+	dd->tfm = crypto_alloc_ahash(dd->alg_name, 0, 0);
+	if (IS_ERR(dd->tfm)) {
+		ti->error = "Cannot initialize hash function";
+		r = PTR_ERR(dd->tfm);
+		dd->tfm = NULL;
+		goto bad;
+	}
+	dd->digest_size = crypto_ahash_digestsize(dd->tfm);
+	if (dd->digest_size > DM_DIGEST_MAX_DIGEST_SIZE) {
+		ti->error = "Digest size too big";
+		r = -EINVAL;
+		goto bad;
+	}
+	dd->ahash_reqsize = sizeof(struct ahash_request) +
+		crypto_ahash_reqsize(dd->tfm);
+
+	if (dd->nr_chunks > SIZE_MAX / dd->digest_size) {
+		ti->error = "Too many chunks";
+		r = -EINVAL;
+		goto bad;
+	}
+
+	dd->digests = vzalloc((size_t)dd->nr_chunks * dd->digest_size);
+	dd->hashed = vzalloc(BITS_TO_LONGS(dd->nr_chunks) * sizeof(long));
+	dd->reading = vzalloc(BITS_TO_LONGS(dd->nr_chunks) * sizeof(long));
+	if (!dd->digests || !dd->hashed || !dd->reading) {
+		ti->error = "Cannot allocate digest map";
+		r = -ENOMEM;
+		goto bad;
+	}
+
+	dd->wq = alloc_workqueue("kdigestd", WQ_CPU_INTENSIVE | WQ_MEM_RECLAIM |
+				 WQ_UNBOUND, num_online_cpus());
+	if (!dd->wq) {
+		ti->error = "Cannot allocate workqueue";
+		r = -ENOMEM;
+		goto bad;
+	}
+
+	dd->io_client = dm_io_client_create();
+	if (IS_ERR(dd->io_client)) {
+		ti->error = "Cannot allocate dm io client";
+		r = PTR_ERR(dd->io_client);
+		goto bad;
+	}
+
+	r = dm_set_target_max_io_len(ti, chunk_sectors);
+	if (r)
+		goto bad;
+
+	ti->per_io_data_size = roundup(sizeof(struct dm_digest_io) +
+				       dd->ahash_reqsize + dd->digest_size,
+				       __alignof__(struct dm_digest_io));
+
+	if (!IS_ERR_OR_NULL(dm_digest_debugfs_root)) {
+		snprintf(name, sizeof(name), "%s-%llu-%u",
+			 dm_device_name(dm_table_get_md(ti->table)),
+			 (unsigned long long)ti->begin,
+			 atomic_inc_return(&dm_digest_instances));
+		dd->debugfs = debugfs_create_file(name, 0400,
+						  dm_digest_debugfs_root, dd,
+						  &digest_debugfs_fops);
+	}
+
+	return 0;
+
+bad:
+	digest_dtr(ti);
+
+	return r;
+}
+
+static struct target_type digest_target = {
+	.name		= "digest",
+	.version	= {1, 2, 0},
+	.module		= THIS_MODULE,
+	.ctr		= digest_ctr,
+	.dtr		= digest_dtr,
+	.map		= digest_map,
+	.postsuspend	= digest_postsuspend,
+	.status		= digest_status,
+	.prepare_ioctl	= digest_prepare_ioctl,
+	.iterate_devices = digest_iterate_devices,
+};
+
+static int __init dm_digest_init(void)
+{
+	int r;
+
+	dm_digest_debugfs_root = debugfs_create_dir("dm-digest", NULL);
+
+	r = dm_register_target(&digest_target);
+	if (r < 0) {
+		DMERR("register failed %d", r);
+		debugfs_remove_recursive(dm_digest_debugfs_root);
+	}
+
+	return r;
+}
+
+static void __exit dm_digest_exit(void)
+{
+	dm_unregister_target(&digest_target);
+	debugfs_remove_recursive(dm_digest_debugfs_root);
+}
+
+module_init(dm_digest_init);
+module_exit(dm_digest_exit);
+
+MODULE_DESCRIPTION(DM_NAME " target recording a digest of every chunk read");
+MODULE_LICENSE("GPL");
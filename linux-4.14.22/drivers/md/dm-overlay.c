@@ -0,0 +1,617 @@
+/*
+ * A lightweight writable overlay over a read-only origin device, for
+ * running fsck on or mounting suspect disks without modifying them.
+ *
+ * Writes are redirected, a page sized chunk at a time, into a sparse
+ * store, either memory or a store device (a loop device for a file
+ * backed store). A radix tree maps the chunks written so far to their
+ * place in the store. Reads are served from the store for those chunks
+ * and from the origin for everything else.
+ *
+ * Unlike dm-snapshot there is no exception store and no kcopyd: writes
+ * to chunks that are already in the overlay are remapped straight to the
+ * store, and writes to new chunks are batched up and handed to a worker,
+ * which allocates their chunks and only copies from the origin when the
+ * write does not cover the whole chunk. The overlay is not persistent,
+ * it is discarded when the target is destroyed.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/highmem.h>
+#include <linux/radix-tree.h>
+#include <linux/slab.h>
+#include <linux/device-mapper.h>
+
+#define DM_MSG_PREFIX "overlay"
+
+#define OVERLAY_CHUNK_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+#define OVERLAY_CHUNK_SECTORS	(1 << OVERLAY_CHUNK_SHIFT)
+
+/* Radix tree tag of a chunk whose first write is still in flight */
+#define OVERLAY_PENDING		0
+/*
+ * Radix tree tag of a chunk whose first write failed: it is not in the
+ * overlay, but its entry keeps its store chunk for the next chunk added.
+ */
+#define OVERLAY_FREE		1
+
+struct dm_overlay {
+	struct dm_target *ti;
+	struct dm_dev *origin;
+	struct dm_dev *store;		/* NULL for a memory store */
+	sector_t store_chunks;		/* capacity of the store device */
+	unsigned long store_used;	/* store chunks handed out so far */
+
+	spinlock_t lock;		/* protects chunks and the bio lists */
+	struct radix_tree_root chunks;	/* chunk -> page or store chunk */
+	unsigned long nr_chunks;	/* chunks in the overlay */
+	struct bio_list deferred;	/* for the worker */
+	struct bio_list waiting;	/* for pending chunks */
+
+	struct workqueue_struct *wq;
+	struct work_struct worker;
+	struct page *copy_page;		/* worker only */
+};
+
+struct dm_overlay_io {
+	unsigned long chunk;
+	bool pending;			/* fills a pending chunk */
+};
+
+/*
+ * Chunks in a store device are kept in the radix tree as exceptional
+ * entries, pages of a memory store as they are.
+ */
+static void *store_to_entry(unsigned long store_chunk)
+{
+	return (void *)((store_chunk << RADIX_TREE_EXCEPTIONAL_SHIFT) |
+			RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static unsigned long entry_to_store(void *entry)
+{
+	return (unsigned long)entry >> RADIX_TREE_EXCEPTIONAL_SHIFT;
+}
+
+static unsigned long overlay_chunk(struct dm_target *ti, struct bio *bio)
+{
+	return dm_target_offset(ti, bio->bi_iter.bi_sector) >>
+		OVERLAY_CHUNK_SHIFT;
+}
+
+/* Offset of the bio in its chunk, in sectors */
+static unsigned overlay_chunk_offset(struct dm_target *ti, struct bio *bio)
+{
+	return dm_target_offset(ti, bio->bi_iter.bi_sector) &
+		(OVERLAY_CHUNK_SECTORS - 1);
+}
+
+/*
+ * Look up the chunk of @bio. Returns false if the bio had to be queued:
+ * I/O to a pending chunk waits for the write that fills it and, if @defer,
+ * writes to chunks not in the overlay yet are deferred to the worker.
+ */
+static bool overlay_lookup(struct dm_overlay *ov, struct bio *bio,
+			   unsigned long chunk, bool defer, void **entry)
+{
+	bool queued = false;
+
+	spin_lock_irq(&ov->lock);
+	*entry = radix_tree_lookup(&ov->chunks, chunk);
+	if (*entry && radix_tree_tag_get(&ov->chunks, chunk, OVERLAY_FREE))
+		*entry = NULL;
+	if (*entry) {
+		if (radix_tree_tag_get(&ov->chunks, chunk, OVERLAY_PENDING)) {
+			bio_list_add(&ov->waiting, bio);
+			queued = true;
+		}
+	} else if (defer && bio_data_dir(bio) == WRITE) {
+		bio_list_add(&ov->deferred, bio);
+		queued = true;
+	}
+	spin_unlock_irq(&ov->lock);
+
+	if (queued && defer && !*entry)
+		queue_work(ov->wq, &ov->worker);
+
+	return !queued;
+}
+
+static void overlay_copy_bio(struct dm_target *ti, struct bio *bio,
+			     struct page *page)
+{
+	unsigned offset = overlay_chunk_offset(ti, bio) << SECTOR_SHIFT;
+	void *chunk = kmap_atomic(page);
+	struct bvec_iter iter;
+	struct bio_vec bv;
+
+	bio_for_each_segment(bv, bio, iter) {
+		void *data = kmap_atomic(bv.bv_page);
+
+		if (bio_data_dir(bio) == WRITE) {
+			memcpy(chunk + offset, data + bv.bv_offset, bv.bv_len);
+		} else {
+			memcpy(data + bv.bv_offset, chunk + offset, bv.bv_len);
+			flush_dcache_page(bv.bv_page);
+		}
+		kunmap_atomic(data);
+		offset += bv.bv_len;
+	}
+	kunmap_atomic(chunk);
+}
+
+static void overlay_remap_store(struct dm_target *ti, struct bio *bio,
+				unsigned long store_chunk)
+{
+	struct dm_overlay *ov = ti->private;
+
+	sector_t sector = (sector_t)store_chunk << OVERLAY_CHUNK_SHIFT;
+
+	bio->bi_iter.bi_sector = sector + overlay_chunk_offset(ti, bio);
+	bio_set_dev(bio, ov->store->bdev);
+}
+
+/*
+ * Send I/O to a chunk that is either in the overlay or, for reads, not
+ * yet written to where it belongs.
+ */
+static int overlay_submit(struct dm_target *ti, struct bio *bio, void *entry)
+{
+	struct dm_overlay *ov = ti->private;
+
+	if (!entry) {
+		bio_set_dev(bio, ov->origin->bdev);
+		bio->bi_iter.bi_sector =
+			dm_target_offset(ti, bio->bi_iter.bi_sector);
+		return DM_MAPIO_REMAPPED;
+	}
+
+	if (!ov->store) {
+		overlay_copy_bio(ti, bio, entry);
+		bio_endio(bio);
+		return DM_MAPIO_SUBMITTED;
+	}
+
+	overlay_remap_store(ti, bio, entry_to_store(entry));
+	return DM_MAPIO_REMAPPED;
+}
+
+static int overlay_rw_page(struct block_device *bdev, sector_t sector,
+			   struct page *page, int op)
+{
+	struct bio *bio;
+	int r;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio_set_dev(bio, bdev);
+	bio->bi_iter.bi_sector = sector;
+	bio_set_op_attrs(bio, op, 0);
+	bio_add_page(bio, page, PAGE_SIZE, 0);
+
+	r = submit_bio_wait(bio);
+	bio_put(bio);
+
+	return r;
+}
+
+/*
+ * Find a store chunk for a new chunk: the one of a chunk whose first write
+ * failed if any, returned in @free_chunk, or else the next one never used.
+ * overlay_insert() takes it, so that it is not lost if the chunk cannot be
+ * added. Only the worker adds chunks, so it is still free by then.
+ */
+static int overlay_find_store(struct dm_overlay *ov, unsigned long *store_chunk,
+			      unsigned long *free_chunk, bool *reuse)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+	int r = 0;
+
+	*reuse = false;
+
+	spin_lock_irq(&ov->lock);
+	radix_tree_for_each_tagged(slot, &ov->chunks, &iter, 0, OVERLAY_FREE) {
+		*store_chunk = entry_to_store(
+			radix_tree_deref_slot_protected(slot, &ov->lock));
+		*free_chunk = iter.index;
+		*reuse = true;
+		break;
+	}
+	if (!*reuse) {
+		*store_chunk = ov->store_used;
+		if (*store_chunk >= ov->store_chunks)
+			r = -ENOSPC;
+	}
+	spin_unlock_irq(&ov->lock);
+
+	return r;
+}
+
+/*
+ * Add a chunk. @free_chunk is the chunk whose store chunk it reuses, NULL
+ * for a page of a memory store or a store chunk never used before.
+ */
+static int overlay_insert(struct dm_overlay *ov, unsigned long chunk,
+			  void *entry, bool pending, unsigned long *free_chunk)
+{
+	int r;
+
+	r = radix_tree_preload(GFP_NOIO);
+	if (r)
+		return r;
+
+	spin_lock_irq(&ov->lock);
+	if (free_chunk && *free_chunk == chunk) {
+		/* Its own store chunk, left by a failed write */
+		radix_tree_tag_clear(&ov->chunks, chunk, OVERLAY_FREE);
+	} else {
+		r = radix_tree_insert(&ov->chunks, chunk, entry);
+		if (!r && free_chunk)
+			radix_tree_delete(&ov->chunks, *free_chunk);
+		else if (!r && ov->store)
+			ov->store_used++;
+	}
+	if (!r) {
+		if (pending)
+			radix_tree_tag_set(&ov->chunks, chunk, OVERLAY_PENDING);
+		ov->nr_chunks++;
+	}
+	spin_unlock_irq(&ov->lock);
+
+	radix_tree_preload_end();
+
+	return r;
+}
+
+/*
+ * Add the chunk of a write to the overlay. Only the worker does this, so
+ * the chunk cannot be added behind our back.
+ */
+static void overlay_add_chunk(struct dm_target *ti, struct bio *bio,
+			      unsigned long chunk)
+{
+	struct dm_overlay *ov = ti->private;
+	struct dm_overlay_io *io = dm_per_bio_data(bio, sizeof(*io));
+	sector_t origin_sector = (sector_t)chunk << OVERLAY_CHUNK_SHIFT;
+	sector_t store_sector;
+	bool whole = bio_sectors(bio) == OVERLAY_CHUNK_SECTORS;
+	unsigned long store_chunk, free_chunk;
+	struct page *page;
+	bool reuse;
+	int r;
+
+	if (!ov->store) {
+		page = alloc_page(GFP_NOIO);
+		if (!page)
+			goto error;
+		page->index = chunk;
+
+		if (!whole && overlay_rw_page(ov->origin->bdev, origin_sector,
+					      page, REQ_OP_READ)) {
+			__free_page(page);
+			goto error;
+		}
+
+		overlay_copy_bio(ti, bio, page);
+		if (overlay_insert(ov, chunk, page, false, NULL)) {
+			__free_page(page);
+			goto error;
+		}
+
+		bio_endio(bio);
+		return;
+	}
+
+	if (overlay_find_store(ov, &store_chunk, &free_chunk, &reuse)) {
+		DMERR_LIMIT("store device is full");
+		goto error;
+	}
+
+	/*
+	 * A write that covers the whole chunk needs nothing from the
+	 * origin, but I/O to the chunk has to wait for it to complete.
+	 * Otherwise bring in the rest of the chunk first.
+	 */
+	if (!whole) {
+		store_sector = (sector_t)store_chunk << OVERLAY_CHUNK_SHIFT;
+		r = overlay_rw_page(ov->origin->bdev, origin_sector,
+				    ov->copy_page, REQ_OP_READ);
+		if (!r)
+			r = overlay_rw_page(ov->store->bdev, store_sector,
+					    ov->copy_page, REQ_OP_WRITE);
+		if (r) {
+			DMERR_LIMIT("chunk %lu: copy from origin failed: %d",
+				    chunk, r);
+			goto error;
+		}
+	}
+
+	if (overlay_insert(ov, chunk, store_to_entry(store_chunk), whole,
+			   reuse ? &free_chunk : NULL))
+		goto error;
+
+	io->chunk = chunk;
+	io->pending = whole;
+	overlay_remap_store(ti, bio, store_chunk);
+	generic_make_request(bio);
+	return;
+
+error:
+	bio_io_error(bio);
+}
+
+static void overlay_work(struct work_struct *work)
+{
+	struct dm_overlay *ov = container_of(work, struct dm_overlay, worker);
+	struct dm_target *ti = ov->ti;
+	struct bio_list bios;
+	struct blk_plug plug;
+	struct bio *bio;
+
+	spin_lock_irq(&ov->lock);
+	bios = ov->deferred;
+	bio_list_init(&ov->deferred);
+	spin_unlock_irq(&ov->lock);
+
+	blk_start_plug(&plug);
+	while ((bio = bio_list_pop(&bios))) {
+		unsigned long chunk = overlay_chunk(ti, bio);
+		void *entry;
+
+		if (!overlay_lookup(ov, bio, chunk, false, &entry))
+			continue;
+
+		if (!entry && bio_data_dir(bio) == WRITE)
+			overlay_add_chunk(ti, bio, chunk);
+		else if (overlay_submit(ti, bio, entry) == DM_MAPIO_REMAPPED)
+			generic_make_request(bio);
+	}
+	blk_finish_plug(&plug);
+}
+
+static int overlay_map(struct dm_target *ti, struct bio *bio)
+{
+	struct dm_overlay *ov = ti->private;
+	struct dm_overlay_io *io = dm_per_bio_data(bio, sizeof(*io));
+	unsigned long chunk;
+	void *entry;
+
+	io->pending = false;
+
+	if (bio->bi_opf & REQ_PREFLUSH) {
+		if (!ov->store) {
+			bio_endio(bio);
+			return DM_MAPIO_SUBMITTED;
+		}
+		bio_set_dev(bio, ov->store->bdev);
+		return DM_MAPIO_REMAPPED;
+	}
+
+	chunk = overlay_chunk(ti, bio);
+	if (!overlay_lookup(ov, bio, chunk, true, &entry))
+		return DM_MAPIO_SUBMITTED;
+
+	return overlay_submit(ti, bio, entry);
+}
+
+static int overlay_end_io(struct dm_target *ti, struct bio *bio,
+			  blk_status_t *error)
+{
+	struct dm_overlay *ov = ti->private;
+	struct dm_overlay_io *io = dm_per_bio_data(bio, sizeof(*io));
+	unsigned long flags;
+
+	if (!io->pending)
+		return DM_ENDIO_DONE;
+
+	/*
+	 * The chunk is now filled, or if the write failed, dropped again,
+	 * its store chunk left for the next chunk added. Either way, the I/O
+	 * waiting for it can go ahead.
+	 */
+	spin_lock_irqsave(&ov->lock, flags);
+	radix_tree_tag_clear(&ov->chunks, io->chunk, OVERLAY_PENDING);
+	if (*error) {
+		radix_tree_tag_set(&ov->chunks, io->chunk, OVERLAY_FREE);
+		ov->nr_chunks--;
+	}
+	bio_list_merge(&ov->deferred, &ov->waiting);
+	bio_list_init(&ov->waiting);
+	spin_unlock_irqrestore(&ov->lock, flags);
+
+	queue_work(ov->wq, &ov->worker);
+
+	return DM_ENDIO_DONE;
+}
+
+static void overlay_status(struct dm_target *ti, status_type_t type,
+			   unsigned status_flags, char *result, unsigned maxlen)
+{
+	struct dm_overlay *ov = ti->private;
+	unsigned sz = 0;
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		if (ov->store)
+			DMEMIT("%lu/%llu", ov->nr_chunks,
+			       (unsigned long long)ov->store_chunks);
+		else
+			DMEMIT("%lu/-", ov->nr_chunks);
+		break;
+	case STATUSTYPE_TABLE:
+		DMEMIT("%s %s", ov->origin->name,
+		       ov->store ? ov->store->name : "-");
+		break;
+	}
+}
+
+static int overlay_iterate_devices(struct dm_target *ti,
+				   iterate_devices_callout_fn fn, void *data)
+{
+	struct dm_overlay *ov = ti->private;
+	int r;
+
+	r = fn(ti, ov->origin, 0, ti->len, data);
+	if (r || !ov->store)
+		return r;
+
+	/* Written chunks are read from and written to the store */
+	return fn(ti, ov->store, 0, ov->store_chunks << OVERLAY_CHUNK_SHIFT,
+		  data);
+}
+
+static void overlay_free_chunks(struct dm_overlay *ov)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+
+	radix_tree_for_each_slot(slot, &ov->chunks, &iter, 0) {
+		if (!ov->store)
+			__free_page(radix_tree_deref_slot(slot));
+		radix_tree_iter_delete(&ov->chunks, &iter, slot);
+	}
+}
+
+static void overlay_dtr(struct dm_target *ti)
+{
+	struct dm_overlay *ov = ti->private;
+
+	if (ov->wq)
+		destroy_workqueue(ov->wq);
+
+	overlay_free_chunks(ov);
+
+	if (ov->copy_page)
+		__free_page(ov->copy_page);
+
+	if (ov->store)
+		dm_put_device(ti, ov->store);
+	if (ov->origin)
+		dm_put_device(ti, ov->origin);
+
+	kfree(ov);
+}
+
+/*
+ * Construct an overlay mapping:
+ * <origin_dev> <store_dev | ->
+ *
+ * With "-" written chunks are kept in memory.
+ */
+static int overlay_ctr(struct dm_target *ti, unsigned argc, char **argv)
+{
+	struct dm_overlay *ov;
+	int r;
+
+	if (argc != 2) {
+		ti->error = "Invalid argument count";
+		return -EINVAL;
+	}
+
+	if (ti->len & (OVERLAY_CHUNK_SECTORS - 1)) {
+		ti->error = "Length must be a multiple of the page size";
+		return -EINVAL;
+	}
+
+	if ((ti->len >> OVERLAY_CHUNK_SHIFT) > ULONG_MAX) {
+		ti->error = "Device too large";
+		return -EINVAL;
+	}
+
+	ov = kzalloc(sizeof(*ov), GFP_KERNEL);
+	if (!ov) {
+		ti->error = "Cannot allocate overlay context";
+		return -ENOMEM;
+	}
+	ti->private = ov;
+	ov->ti = ti;
+	spin_lock_init(&ov->lock);
+	INIT_RADIX_TREE(&ov->chunks, GFP_ATOMIC);
+	bio_list_init(&ov->deferred);
+	bio_list_init(&ov->waiting);
+	INIT_WORK(&ov->worker, overlay_work);
+
+	/* The origin is never written to */
+	r = dm_get_device(ti, argv[0], FMODE_READ, &ov->origin);
+	if (r) {
+		ti->error = "Origin device lookup failed";
+		goto bad;
+	}
+
+	if (strcmp(argv[1], "-")) {
+		r = dm_get_device(ti, argv[1], dm_table_get_mode(ti->table),
+				  &ov->store);
+		if (r) {
+			ti->error = "Store device lookup failed";
+			goto bad;
+		}
+		ov->store_chunks = i_size_read(ov->store->bdev->bd_inode) >>
+			PAGE_SHIFT;
+
+		ov->copy_page = alloc_page(GFP_KERNEL);
+		if (!ov->copy_page) {
+			ti->error = "Cannot allocate copy buffer";
+			r = -ENOMEM;
+			goto bad;
+		}
+	}
+
+	ov->wq = alloc_workqueue("koverlayd", WQ_MEM_RECLAIM, 0);
+	if (!ov->wq) {
+		ti->error = "Cannot allocate workqueue";
+		r = -ENOMEM;
+		goto bad;
+	}
+
+	r = dm_set_target_max_io_len(ti, OVERLAY_CHUNK_SECTORS);
+	if (r)
+		goto bad;
+
+	ti->num_flush_bios = 1;
+	ti->per_io_data_size = sizeof(struct dm_overlay_io);
+
+	return 0;
+
+bad:
+	overlay_dtr(ti);
+
+	return r;
+}
+
+static struct target_type overlay_target = {
+	.name		= "overlay",
+	.version	= {1, 0, 0},
+	.module		= THIS_MODULE,
+	.ctr		= overlay_ctr,
+	.dtr		= overlay_dtr,
+	.map		= overlay_map,
+	.end_io		= overlay_end_io,
+	.status		= overlay_status,
+	.iterate_devices = overlay_iterate_devices,
+};
+
+static int __init dm_overlay_init(void)
+{
+	int r;
+
+	r = dm_register_target(&overlay_target);
+	if (r < 0)
+		DMERR("register failed %d", r);
+
+	return r;
+}
+
+static void __exit dm_overlay_exit(void)
+{
+	dm_unregister_target(&overlay_target);
+}
+
+module_init(dm_overlay_init);
+module_exit(dm_overlay_exit);
+
+MODULE_DESCRIPTION(DM_NAME " writable sparse overlay over a read-only device");
+MODULE_LICENSE("GPL");
@@ -265,6 +265,23 @@ static void iwl_mvm_rx_csum(struct ieee80211_sta *sta,
 		skb->ip_summed = CHECKSUM_UNNECESSARY;
 }
 
+/*
+ * Allocate the skb for a received MPDU, whose data is attached as a page
+ * fragment.  In the NAPI poll, the skb head comes from the per-CPU NAPI
+ * cache, which is refilled in bulk from the slab and by the heads of
+ * consumed skbs, rather than from one slab allocation per frame.
+ */
+struct sk_buff *iwl_mvm_rx_alloc_skb(struct napi_struct *napi)
+{
+	/* Dont use dev_alloc_skb(), we'll have enough headroom once
+	 * ieee80211_hdr pulled.
+	 */
+	if (!napi)
+		return alloc_skb(128, GFP_ATOMIC);
+
+	return napi_alloc_skb(napi, 128);
+}
+
 /*
  * iwl_mvm_rx_rx_mpdu - REPLY_RX_MPDU_CMD handler
  *
@@ -293,10 +310,7 @@ void iwl_mvm_rx_rx_mpdu(struct iwl_mvm *mvm, struct napi_struct *napi,
 	rx_pkt_status = le32_to_cpup((__le32 *)
 		(pkt->data + sizeof(*rx_res) + len));
 
-	/* Dont use dev_alloc_skb(), we'll have enough headroom once
-	 * ieee80211_hdr pulled.
-	 */
-	skb = alloc_skb(128, GFP_ATOMIC);
+	skb = iwl_mvm_rx_alloc_skb(napi);
 	if (!skb) {
 		IWL_ERR(mvm, "alloc_skb failed\n");
 		return;
@@ -805,10 +805,7 @@ void iwl_mvm_rx_mpdu_mq(struct iwl_mvm *mvm, struct napi_struct *napi,
 	struct sk_buff *skb;
 	u8 crypt_len = 0;
 
-	/* Dont use dev_alloc_skb(), we'll have enough headroom once
-	 * ieee80211_hdr pulled.
-	 */
-	skb = alloc_skb(128, GFP_ATOMIC);
+	skb = iwl_mvm_rx_alloc_skb(napi);
 	if (!skb) {
 		IWL_ERR(mvm, "alloc_skb failed\n");
 		return;
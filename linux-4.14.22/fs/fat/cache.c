@@ -12,11 +12,16 @@
 #include <linux/slab.h>
 #include "fat.h"
 
-/* this must be > 0. */
-#define FAT_MAX_CACHE	8
+/*
+ * this must be > 0.  The caches are kept in an rbtree sorted by file
+ * cluster, so a lookup stays cheap even when a fragmented file needs many
+ * of them.
+ */
+#define FAT_MAX_CACHE	128
 
 struct fat_cache {
 	struct list_head cache_list;
+	struct rb_node cache_node;
 	int nr_contig;	/* number of contiguous clusters */
 	int fcluster;	/* cluster number in the file. */
 	int dcluster;	/* cluster number on disk. */
@@ -41,6 +46,7 @@ static void init_once(void *foo)
 	struct fat_cache *cache = (struct fat_cache *)foo;
 
 	INIT_LIST_HEAD(&cache->cache_list);
+	RB_CLEAR_NODE(&cache->cache_node);
 }
 
 int __init fat_cache_init(void)
@@ -77,29 +83,59 @@ static inline void fat_cache_update_lru(struct inode *inode,
 		list_move(&cache->cache_list, &MSDOS_I(inode)->cache_lru);
 }
 
+/* Find the cache of "fclus" or nearest cache before it. */
+static struct fat_cache *fat_cache_find(struct inode *inode, int fclus)
+{
+	struct rb_node *n = MSDOS_I(inode)->cache_tree.rb_node;
+	struct fat_cache *p, *hit = NULL;
+
+	while (n) {
+		p = rb_entry(n, struct fat_cache, cache_node);
+		if (fclus < p->fcluster) {
+			n = n->rb_left;
+		} else {
+			hit = p;
+			if (fclus == p->fcluster)
+				break;
+			n = n->rb_right;
+		}
+	}
+	return hit;
+}
+
+static void fat_cache_insert(struct inode *inode, struct fat_cache *cache)
+{
+	struct rb_node **n = &MSDOS_I(inode)->cache_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct fat_cache *p;
+
+	while (*n) {
+		parent = *n;
+		p = rb_entry(parent, struct fat_cache, cache_node);
+		if (cache->fcluster < p->fcluster)
+			n = &parent->rb_left;
+		else
+			n = &parent->rb_right;
+	}
+	rb_link_node(&cache->cache_node, parent, n);
+	rb_insert_color(&cache->cache_node, &MSDOS_I(inode)->cache_tree);
+}
+
 static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
-	static struct fat_cache nohit = { .fcluster = 0, };
-
-	struct fat_cache *hit = &nohit, *p;
+	struct fat_cache *hit;
 	int offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
-			hit = p;
-			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
-				break;
-			}
-		}
-	}
-	if (hit != &nohit) {
+	hit = fat_cache_find(inode, fclus);
+	if (hit) {
+		if ((hit->fcluster + hit->nr_contig) < fclus)
+			offset = hit->nr_contig;
+		else
+			offset = fclus - hit->fcluster;
+
 		fat_cache_update_lru(inode, hit);
 
 		cid->id = MSDOS_I(inode)->cache_valid_id;
@@ -119,14 +155,13 @@ static struct fat_cache *fat_cache_merge(struct inode *inode,
 {
 	struct fat_cache *p;
 
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
-			BUG_ON(p->dcluster != new->dcluster);
-			if (new->nr_contig > p->nr_contig)
-				p->nr_contig = new->nr_contig;
-			return p;
-		}
+	/* Find the same part as "new" in cluster-chain. */
+	p = fat_cache_find(inode, new->fcluster);
+	if (p && p->fcluster == new->fcluster) {
+		BUG_ON(p->dcluster != new->dcluster);
+		if (new->nr_contig > p->nr_contig)
+			p->nr_contig = new->nr_contig;
+		return p;
 	}
 	return NULL;
 }
@@ -168,10 +203,13 @@ static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 		} else {
 			struct list_head *p = MSDOS_I(inode)->cache_lru.prev;
 			cache = list_entry(p, struct fat_cache, cache_list);
+			rb_erase(&cache->cache_node,
+				 &MSDOS_I(inode)->cache_tree);
 		}
 		cache->fcluster = new->fcluster;
 		cache->dcluster = new->dcluster;
 		cache->nr_contig = new->nr_contig;
+		fat_cache_insert(inode, cache);
 	}
 out_update_lru:
 	fat_cache_update_lru(inode, cache);
@@ -192,9 +230,11 @@ static void __fat_cache_inval_inode(struct inode *inode)
 		cache = list_entry(i->cache_lru.next,
 				   struct fat_cache, cache_list);
 		list_del_init(&cache->cache_list);
+		RB_CLEAR_NODE(&cache->cache_node);
 		i->nr_caches--;
 		fat_cache_free(cache);
 	}
+	i->cache_tree = RB_ROOT;
 	/* Update. The copy of caches before this id is discarded. */
 	i->cache_valid_id++;
 	if (i->cache_valid_id == FAT_CACHE_VALID)
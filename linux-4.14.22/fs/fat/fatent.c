@@ -4,6 +4,8 @@
  */
 
 #include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -459,6 +461,91 @@ static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 	}
 }
 
+static void fat_build_free_bitmap(struct super_block *sb);
+
+/*
+ * Make the free entry "fatent" the new end of the chain being allocated,
+ * linking it after "prev_ent" if there is one.
+ */
+static void fat_alloc_entry(struct super_block *sb, struct fat_entry *fatent,
+			    struct fat_entry *prev_ent,
+			    struct buffer_head **bhs, int *nr_bhs)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	const struct fatent_operations *ops = sbi->fatent_ops;
+	int entry = fatent->entry;
+
+	/* make the cluster chain */
+	ops->ent_put(fatent, FAT_ENT_EOF);
+	if (prev_ent->nr_bhs)
+		ops->ent_put(prev_ent, entry);
+
+	fat_collect_bhs(bhs, nr_bhs, fatent);
+
+	sbi->prev_free = entry;
+	if (sbi->free_clusters != -1)
+		sbi->free_clusters--;
+	if (sbi->free_bitmap)
+		__clear_bit(entry, sbi->free_bitmap);
+}
+
+/* Find the next free cluster after "entry" in the free cluster bitmap. */
+static int fat_find_free_entry(struct msdos_sb_info *sbi, int entry)
+{
+	unsigned long next;
+
+	next = find_next_bit(sbi->free_bitmap, sbi->max_cluster, entry + 1);
+	if (next >= sbi->max_cluster)
+		next = find_next_bit(sbi->free_bitmap, sbi->max_cluster,
+				     FAT_START_ENT);
+	if (next >= sbi->max_cluster)
+		return -1;
+	return next;
+}
+
+/*
+ * Allocate the clusters from the free cluster bitmap: each one is found
+ * without looking at the FAT, which is only read for the entries that
+ * are changed.
+ */
+static int fat_alloc_clusters_bitmap(struct inode *inode, int *cluster,
+				     int nr_cluster, struct fat_entry *fatent,
+				     struct fat_entry *prev_ent,
+				     struct buffer_head **bhs, int *nr_bhs,
+				     int *idx_clus)
+{
+	struct super_block *sb = inode->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	int entry = sbi->prev_free;
+	int nr;
+
+	while (*idx_clus < nr_cluster) {
+		entry = fat_find_free_entry(sbi, entry);
+		if (entry < 0)
+			return -ENOSPC;
+
+		nr = fat_ent_read(inode, fatent, entry);
+		if (nr < 0)
+			return nr;
+		if (nr != FAT_ENT_FREE) {
+			fat_fs_error(sb, "%s: free cluster bitmap is out of "
+				     "date (entry 0x%08x)", __func__, entry);
+			return -EIO;
+		}
+
+		fat_alloc_entry(sb, fatent, prev_ent, bhs, nr_bhs);
+		cluster[*idx_clus] = entry;
+		(*idx_clus)++;
+
+		/*
+		 * fat_collect_bhs() gets ref-count of bhs,
+		 * so we can still use the prev_ent.
+		 */
+		*prev_ent = *fatent;
+	}
+	return 0;
+}
+
 int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 {
 	struct super_block *sb = inode->i_sb;
@@ -481,6 +568,18 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
+
+	if (!sbi->free_bitmap)
+		fat_build_free_bitmap(sb);
+	if (sbi->free_bitmap) {
+		err = fat_alloc_clusters_bitmap(inode, cluster, nr_cluster,
+						&fatent, &prev_ent, bhs,
+						&nr_bhs, &idx_clus);
+		if (err == -ENOSPC)
+			goto out_nospc;
+		goto out;
+	}
+
 	fatent_set_entry(&fatent, sbi->prev_free + 1);
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
@@ -495,16 +594,8 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
 				int entry = fatent.entry;
 
-				/* make the cluster chain */
-				ops->ent_put(&fatent, FAT_ENT_EOF);
-				if (prev_ent.nr_bhs)
-					ops->ent_put(&prev_ent, entry);
-
-				fat_collect_bhs(bhs, &nr_bhs, &fatent);
-
-				sbi->prev_free = entry;
-				if (sbi->free_clusters != -1)
-					sbi->free_clusters--;
+				fat_alloc_entry(sb, &fatent, &prev_ent,
+						bhs, &nr_bhs);
 
 				cluster[idx_clus] = entry;
 				idx_clus++;
@@ -523,6 +614,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		} while (fat_ent_next(sbi, &fatent));
 	}
 
+out_nospc:
 	/* Couldn't allocate the free entries */
 	sbi->free_clusters = 0;
 	sbi->free_clus_valid = 1;
@@ -591,6 +683,8 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		if (sbi->free_bitmap)
+			__set_bit(fatent.entry, sbi->free_bitmap);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			dirty_fsinfo = 1;
@@ -646,7 +740,12 @@ static void fat_ent_reada(struct super_block *sb, struct fat_entry *fatent,
 		sb_breadahead(sb, blocknr + i);
 }
 
-int fat_count_free_clusters(struct super_block *sb)
+/*
+ * Count the free clusters by reading the whole FAT, marking them in
+ * "bitmap" too if there is one.  Called with fat_lock held.
+ */
+static int __fat_count_free_clusters(struct super_block *sb,
+				     unsigned long *bitmap)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 	const struct fatent_operations *ops = sbi->fatent_ops;
@@ -654,10 +753,6 @@ int fat_count_free_clusters(struct super_block *sb)
 	unsigned long reada_blocks, reada_mask, cur_block;
 	int err = 0, free;
 
-	lock_fat(sbi);
-	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
-		goto out;
-
 	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
 	reada_mask = reada_blocks - 1;
 	cur_block = 0;
@@ -678,14 +773,61 @@ int fat_count_free_clusters(struct super_block *sb)
 			goto out;
 
 		do {
-			if (ops->ent_get(&fatent) == FAT_ENT_FREE)
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
 				free++;
+				if (bitmap)
+					__set_bit(fatent.entry, bitmap);
+			}
 		} while (fat_ent_next(sbi, &fatent));
 	}
 	sbi->free_clusters = free;
 	sbi->free_clus_valid = 1;
 	mark_fsinfo_dirty(sb);
+out:
 	fatent_brelse(&fatent);
+	return err;
+}
+
+/*
+ * Build the bitmap of free clusters, so that fat_alloc_clusters() doesn't
+ * have to scan the FAT for them.  It is built the first time it is needed
+ * and kept up to date until unmount.  If it can't be built, allocation
+ * just falls back to scanning.  Called with fat_lock held.
+ */
+static void fat_build_free_bitmap(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	unsigned long *bitmap;
+	unsigned int nofs_flag;
+
+	nofs_flag = memalloc_nofs_save();
+	bitmap = kvzalloc(BITS_TO_LONGS(sbi->max_cluster) * sizeof(long),
+			  GFP_KERNEL | __GFP_NOWARN);
+	memalloc_nofs_restore(nofs_flag);
+	if (!bitmap)
+		return;
+
+	if (__fat_count_free_clusters(sb, bitmap)) {
+		kvfree(bitmap);
+		return;
+	}
+	sbi->free_bitmap = bitmap;
+}
+
+int fat_count_free_clusters(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	int err = 0;
+
+	lock_fat(sbi);
+	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
+		goto out;
+
+	/* The whole FAT is read anyway, so build the bitmap too */
+	if (!sb_rdonly(sb) && !sbi->free_bitmap)
+		fat_build_free_bitmap(sb);
+	if (sbi->free_clusters == -1 || !sbi->free_clus_valid)
+		err = __fat_count_free_clusters(sb, NULL);
 out:
 	unlock_fat(sbi);
 	return err;
@@ -714,6 +714,7 @@ static void fat_put_super(struct super_block *sb)
 
 	iput(sbi->fsinfo_inode);
 	iput(sbi->fat_inode);
+	kvfree(sbi->free_bitmap);
 
 	call_rcu(&sbi->rcu, delayed_free);
 }
@@ -750,6 +751,7 @@ static void init_once(void *foo)
 	ei->nr_caches = 0;
 	ei->cache_valid_id = FAT_CACHE_VALID + 1;
 	INIT_LIST_HEAD(&ei->cache_lru);
+	ei->cache_tree = RB_ROOT;
 	INIT_HLIST_NODE(&ei->i_fat_hash);
 	INIT_HLIST_NODE(&ei->i_dir_hash);
 	inode_init_once(&ei->vfs_inode);
@@ -12,9 +12,11 @@
 #include <linux/slab.h>
 #include "hfsplus_fs.h"
 
-int hfs_find_init(struct hfs_btree *tree, struct hfs_find_data *fd)
+static int __hfs_find_init(struct hfs_btree *tree, struct hfs_find_data *fd,
+			   bool shared)
 {
 	void *ptr;
+	int subclass;
 
 	fd->tree = tree;
 	fd->bnode = NULL;
@@ -27,27 +29,50 @@ int hfs_find_init(struct hfs_btree *tree, struct hfs_find_data *fd)
 		tree->cnid, __builtin_return_address(0));
 	switch (tree->cnid) {
 	case HFSPLUS_CAT_CNID:
-		mutex_lock_nested(&tree->tree_lock, CATALOG_BTREE_MUTEX);
+		subclass = CATALOG_BTREE_MUTEX;
 		break;
 	case HFSPLUS_EXT_CNID:
-		mutex_lock_nested(&tree->tree_lock, EXTENTS_BTREE_MUTEX);
+		subclass = EXTENTS_BTREE_MUTEX;
 		break;
 	case HFSPLUS_ATTR_CNID:
-		mutex_lock_nested(&tree->tree_lock, ATTR_BTREE_MUTEX);
+		subclass = ATTR_BTREE_MUTEX;
 		break;
 	default:
+		subclass = 0;	/* used-uninitialized warning */
 		BUG();
 	}
+	fd->shared = shared;
+	if (shared)
+		down_read_nested(&tree->tree_lock, subclass);
+	else
+		down_write_nested(&tree->tree_lock, subclass);
 	return 0;
 }
 
+int hfs_find_init(struct hfs_btree *tree, struct hfs_find_data *fd)
+{
+	return __hfs_find_init(tree, fd, false);
+}
+
+/*
+ * For lookups that don't modify the tree: these can run in parallel with
+ * each other, e.g. for concurrent directory traversals.
+ */
+int hfs_find_init_read(struct hfs_btree *tree, struct hfs_find_data *fd)
+{
+	return __hfs_find_init(tree, fd, true);
+}
+
 void hfs_find_exit(struct hfs_find_data *fd)
 {
 	hfs_bnode_put(fd->bnode);
 	kfree(fd->search_key);
 	hfs_dbg(BNODE_REFS, "find_exit: %d (%p)\n",
 		fd->tree->cnid, __builtin_return_address(0));
-	mutex_unlock(&fd->tree->tree_lock);
+	if (fd->shared)
+		up_read(&fd->tree->tree_lock);
+	else
+		up_write(&fd->tree->tree_lock);
 	fd->tree = NULL;
 }
 
@@ -273,6 +298,7 @@ int hfs_brec_goto(struct hfs_find_data *fd, int cnt)
 				bnode = NULL;
 				goto out;
 			}
+			hfs_bnode_readahead(tree, bnode->next);
 		}
 		fd->record += cnt;
 	}
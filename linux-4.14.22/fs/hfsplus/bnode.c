@@ -435,6 +435,12 @@ static struct hfs_bnode *__hfs_bnode_create(struct hfs_btree *tree, u32 cnid)
 		tree->node_hash[hash] = node;
 		tree->node_hash_cnt++;
 	} else {
+		/*
+		 * Readers share the tree lock, so another lookup may have
+		 * hashed this node since our caller missed it: the reference
+		 * we return must be our own.
+		 */
+		hfs_bnode_get(node2);
 		spin_unlock(&tree->hash_lock);
 		kfree(node);
 		wait_event(node2->lock_wq,
@@ -490,6 +496,7 @@ struct hfs_bnode *hfs_bnode_find(struct hfs_btree *tree, u32 num)
 	node = hfs_bnode_findhash(tree, num);
 	if (node) {
 		hfs_bnode_get(node);
+		tree->node_hash_hits++;
 		spin_unlock(&tree->hash_lock);
 		wait_event(node->lock_wq,
 			!test_bit(HFS_BNODE_NEW, &node->flags));
@@ -497,6 +504,7 @@ struct hfs_bnode *hfs_bnode_find(struct hfs_btree *tree, u32 num)
 			goto node_error;
 		return node;
 	}
+	tree->node_hash_misses++;
 	spin_unlock(&tree->hash_lock);
 	node = __hfs_bnode_create(tree, num);
 	if (!node)
@@ -564,6 +572,40 @@ node_error:
 	return ERR_PTR(-EIO);
 }
 
+/*
+ * Start reading node @num from disk, if it isn't in memory yet, without
+ * waiting for it. Leaf siblings tend to be adjacent on disk, so when
+ * walking a chain of leaves this brings in the next few before they are
+ * needed. The readahead state is shared by all users of the tree and
+ * updated without locking, like that of a shared struct file.
+ */
+void hfs_bnode_readahead(struct hfs_btree *tree, u32 num)
+{
+	struct address_space *mapping = tree->inode->i_mapping;
+	struct hfs_bnode *node;
+	struct page *page;
+	pgoff_t index;
+
+	if (!num || num >= tree->node_count)
+		return;
+
+	spin_lock(&tree->hash_lock);
+	node = hfs_bnode_findhash(tree, num);
+	spin_unlock(&tree->hash_lock);
+	if (node)
+		return;
+
+	index = ((loff_t)num << tree->node_size_shift) >> PAGE_SHIFT;
+	page = find_get_page(mapping, index);
+	if (page) {
+		put_page(page);
+		return;
+	}
+
+	page_cache_sync_readahead(mapping, &tree->ra, NULL, index,
+				  tree->pages_per_bnode);
+}
+
 void hfs_bnode_free(struct hfs_bnode *node)
 {
 	int i;
@@ -143,7 +143,7 @@ struct hfs_btree *hfs_btree_open(struct super_block *sb, u32 id)
 	if (!tree)
 		return NULL;
 
-	mutex_init(&tree->tree_lock);
+	init_rwsem(&tree->tree_lock);
 	spin_lock_init(&tree->hash_lock);
 	tree->sb = sb;
 	tree->cnid = id;
@@ -158,6 +158,7 @@ struct hfs_btree *hfs_btree_open(struct super_block *sb, u32 id)
 	}
 
 	mapping = tree->inode->i_mapping;
+	file_ra_state_init(&tree->ra, mapping);
 	page = read_mapping_page(mapping, 0, NULL);
 	if (IS_ERR(page))
 		goto free_inode;
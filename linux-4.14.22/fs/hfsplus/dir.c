@@ -42,7 +42,7 @@ static struct dentry *hfsplus_lookup(struct inode *dir, struct dentry *dentry,
 	sb = dir->i_sb;
 
 	dentry->d_fsdata = NULL;
-	err = hfs_find_init(HFSPLUS_SB(sb)->cat_tree, &fd);
+	err = hfs_find_init_read(HFSPLUS_SB(sb)->cat_tree, &fd);
 	if (err)
 		return ERR_PTR(err);
 	err = hfsplus_cat_build_key(sb, fd.search_key, dir->i_ino,
@@ -143,7 +143,7 @@ static int hfsplus_readdir(struct file *file, struct dir_context *ctx)
 	if (file->f_pos >= inode->i_size)
 		return 0;
 
-	err = hfs_find_init(HFSPLUS_SB(sb)->cat_tree, &fd);
+	err = hfs_find_init_read(HFSPLUS_SB(sb)->cat_tree, &fd);
 	if (err)
 		return err;
 	strbuf = kmalloc(NLS_MAX_CHARSET_SIZE * HFSPLUS_MAX_STRLEN + 1, GFP_KERNEL);
@@ -19,6 +19,9 @@
 
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include <linux/kobject.h>
+#include <linux/completion.h>
 #include <linux/buffer_head.h>
 #include <linux/blkdev.h>
 #include "hfsplus_raw.h"
@@ -90,12 +93,18 @@ struct hfs_btree {
 	unsigned int max_key_len;
 	unsigned int depth;
 
-	struct mutex tree_lock;
+	/* shared by lookups, exclusive for anything modifying the tree */
+	struct rw_semaphore tree_lock;
 
 	unsigned int pages_per_bnode;
 	spinlock_t hash_lock;
 	struct hfs_bnode *node_hash[NODE_HASH_SIZE];
 	int node_hash_cnt;
+	unsigned long node_hash_hits;	/* protected by hash_lock */
+	unsigned long node_hash_misses;	/* protected by hash_lock */
+
+	/* readahead of sibling nodes, see hfs_bnode_readahead() */
+	struct file_ra_state ra;
 };
 
 struct page;
@@ -191,6 +200,10 @@ struct hfsplus_sb_info {
 	int work_queued;               /* non-zero delayed work is queued */
 	struct delayed_work sync_work; /* FS sync delayed work */
 	spinlock_t work_lock;          /* protects sync_work and work_queued */
+
+	/* /sys/fs/hfsplus/<device>/ */
+	struct kobject kobj;
+	struct completion kobj_unregister;
 };
 
 #define HFSPLUS_SB_WRITEBACKUP	0
@@ -292,6 +305,8 @@ struct hfs_find_data {
 	int record;
 	int keyoffset, keylength;
 	int entryoffset, entrylength;
+	/* tree_lock is held shared */
+	bool shared;
 };
 
 struct hfsplus_readdir_data {
@@ -327,6 +342,7 @@ static inline unsigned short hfsplus_min_io_size(struct super_block *sb)
 #define hfs_bnode_unlink hfsplus_bnode_unlink
 #define hfs_bnode_findhash hfsplus_bnode_findhash
 #define hfs_bnode_find hfsplus_bnode_find
+#define hfs_bnode_readahead hfsplus_bnode_readahead
 #define hfs_bnode_unhash hfsplus_bnode_unhash
 #define hfs_bnode_free hfsplus_bnode_free
 #define hfs_bnode_create hfsplus_bnode_create
@@ -337,6 +353,7 @@ static inline unsigned short hfsplus_min_io_size(struct super_block *sb)
 #define hfs_brec_insert hfsplus_brec_insert
 #define hfs_brec_remove hfsplus_brec_remove
 #define hfs_find_init hfsplus_find_init
+#define hfs_find_init_read hfsplus_find_init_read
 #define hfs_find_exit hfsplus_find_exit
 #define __hfs_brec_find __hfsplus_brec_find
 #define hfs_brec_find hfsplus_brec_find
@@ -415,6 +432,7 @@ void hfs_bnode_unlink(struct hfs_bnode *node);
 struct hfs_bnode *hfs_bnode_findhash(struct hfs_btree *tree, u32 cnid);
 void hfs_bnode_unhash(struct hfs_bnode *node);
 struct hfs_bnode *hfs_bnode_find(struct hfs_btree *tree, u32 num);
+void hfs_bnode_readahead(struct hfs_btree *tree, u32 num);
 void hfs_bnode_free(struct hfs_bnode *node);
 struct hfs_bnode *hfs_bnode_create(struct hfs_btree *tree, u32 num);
 void hfs_bnode_get(struct hfs_bnode *node);
@@ -429,6 +447,7 @@ int hfs_brec_remove(struct hfs_find_data *fd);
 
 /* bfind.c */
 int hfs_find_init(struct hfs_btree *tree, struct hfs_find_data *fd);
+int hfs_find_init_read(struct hfs_btree *tree, struct hfs_find_data *fd);
 void hfs_find_exit(struct hfs_find_data *fd);
 int hfs_find_1st_rec_by_cnid(struct hfs_bnode *bnode, struct hfs_find_data *fd,
 			     int *begin, int *end, int *cur_rec);
@@ -506,6 +525,12 @@ int hfs_part_find(struct super_block *sb, sector_t *part_start,
 struct inode *hfsplus_iget(struct super_block *sb, unsigned long ino);
 void hfsplus_mark_mdb_dirty(struct super_block *sb);
 
+/* sysfs.c */
+int hfsplus_register_sysfs(struct super_block *sb);
+void hfsplus_unregister_sysfs(struct super_block *sb);
+int hfsplus_init_sysfs(void);
+void hfsplus_exit_sysfs(void);
+
 /* tables.c */
 extern u16 hfsplus_case_fold_table[];
 extern u16 hfsplus_decompose_table[];
@@ -76,7 +76,7 @@ struct inode *hfsplus_iget(struct super_block *sb, unsigned long ino)
 
 	if (inode->i_ino >= HFSPLUS_FIRSTUSER_CNID ||
 	    inode->i_ino == HFSPLUS_ROOT_CNID) {
-		err = hfs_find_init(HFSPLUS_SB(inode->i_sb)->cat_tree, &fd);
+		err = hfs_find_init_read(HFSPLUS_SB(inode->i_sb)->cat_tree, &fd);
 		if (!err) {
 			err = hfsplus_find_cat(inode->i_sb, inode->i_ino, &fd);
 			if (!err)
@@ -283,6 +283,7 @@ static void hfsplus_put_super(struct super_block *sb)
 	hfs_dbg(SUPER, "hfsplus_put_super\n");
 
 	cancel_delayed_work_sync(&sbi->sync_work);
+	hfsplus_unregister_sysfs(sb);
 
 	if (!sb_rdonly(sb) && sbi->s_vhdr) {
 		struct hfsplus_vh *vhdr = sbi->s_vhdr;
@@ -583,6 +584,10 @@ static int hfsplus_fill_super(struct super_block *sb, void *data, int silent)
 		}
 	}
 
+	err = hfsplus_register_sysfs(sb);
+	if (err)
+		goto out_put_hidden_dir;
+
 	unload_nls(sbi->nls);
 	sbi->nls = nls;
 	return 0;
@@ -673,11 +678,17 @@ static int __init init_hfsplus_fs(void)
 	err = hfsplus_create_attr_tree_cache();
 	if (err)
 		goto destroy_inode_cache;
-	err = register_filesystem(&hfsplus_fs_type);
+	err = hfsplus_init_sysfs();
 	if (err)
 		goto destroy_attr_tree_cache;
+	err = register_filesystem(&hfsplus_fs_type);
+	if (err)
+		goto exit_sysfs;
 	return 0;
 
+exit_sysfs:
+	hfsplus_exit_sysfs();
+
 destroy_attr_tree_cache:
 	hfsplus_destroy_attr_tree_cache();
 
@@ -696,6 +707,7 @@ static void __exit exit_hfsplus_fs(void)
 	 * destroy cache.
 	 */
 	rcu_barrier();
+	hfsplus_exit_sysfs();
 	hfsplus_destroy_attr_tree_cache();
 	kmem_cache_destroy(hfsplus_inode_cachep);
 }
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  linux/fs/hfsplus/sysfs.c
+ *
+ * Per-mount B-tree node cache statistics, in /sys/fs/hfsplus/<device>/:
+ * for the catalog, extents and attributes trees, the number of nodes in
+ * memory and how many node lookups found or missed them.
+ */
+
+#include <linux/fs.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/spinlock.h>
+
+#include "hfsplus_fs.h"
+
+enum {
+	bnode_count,
+	bnode_hits,
+	bnode_misses,
+};
+
+struct hfsplus_attr {
+	struct attribute	attr;
+	int			tree;
+	int			id;
+};
+
+#define HFSPLUS_BTREE_ATTR(_name, _member, _id)				\
+static struct hfsplus_attr hfsplus_attr_##_name##_##_id = {		\
+	.attr = { .name = __stringify(_name) "_bnode_" #_id, .mode = 0444 }, \
+	.tree = offsetof(struct hfsplus_sb_info, _member),		\
+	.id = bnode_##_id,						\
+}
+
+#define HFSPLUS_BTREE_ATTRS(_name, _member)				\
+	HFSPLUS_BTREE_ATTR(_name, _member, count);			\
+	HFSPLUS_BTREE_ATTR(_name, _member, hits);			\
+	HFSPLUS_BTREE_ATTR(_name, _member, misses)
+
+#define ATTR_LIST(_name, _id)	(&hfsplus_attr_##_name##_##_id.attr)
+
+HFSPLUS_BTREE_ATTRS(catalog, cat_tree);
+HFSPLUS_BTREE_ATTRS(extents, ext_tree);
+HFSPLUS_BTREE_ATTRS(attributes, attr_tree);
+
+static struct attribute *hfsplus_attrs[] = {
+	ATTR_LIST(catalog, count),
+	ATTR_LIST(catalog, hits),
+	ATTR_LIST(catalog, misses),
+	ATTR_LIST(extents, count),
+	ATTR_LIST(extents, hits),
+	ATTR_LIST(extents, misses),
+	ATTR_LIST(attributes, count),
+	ATTR_LIST(attributes, hits),
+	ATTR_LIST(attributes, misses),
+	NULL,
+};
+
+static ssize_t hfsplus_attr_show(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	struct hfsplus_sb_info *sbi = container_of(kobj,
+		struct hfsplus_sb_info, kobj);
+	struct hfsplus_attr *a = container_of(attr, struct hfsplus_attr, attr);
+	struct hfs_btree *tree;
+	unsigned long val = 0;
+
+	tree = *(struct hfs_btree **)((char *)sbi + a->tree);
+
+	/* The attributes tree is optional */
+	if (!tree)
+		return sprintf(buf, "0\n");
+
+	spin_lock(&tree->hash_lock);
+	switch (a->id) {
+	case bnode_count:
+		val = tree->node_hash_cnt;
+		break;
+	case bnode_hits:
+		val = tree->node_hash_hits;
+		break;
+	case bnode_misses:
+		val = tree->node_hash_misses;
+		break;
+	}
+	spin_unlock(&tree->hash_lock);
+
+	return sprintf(buf, "%lu\n", val);
+}
+
+static void hfsplus_sb_release(struct kobject *kobj)
+{
+	struct hfsplus_sb_info *sbi = container_of(kobj,
+		struct hfsplus_sb_info, kobj);
+
+	complete(&sbi->kobj_unregister);
+}
+
+static const struct sysfs_ops hfsplus_attr_ops = {
+	.show	= hfsplus_attr_show,
+};
+
+static struct kobj_type hfsplus_sb_ktype = {
+	.default_attrs	= hfsplus_attrs,
+	.sysfs_ops	= &hfsplus_attr_ops,
+	.release	= hfsplus_sb_release,
+};
+
+static struct kset *hfsplus_kset;
+
+int hfsplus_register_sysfs(struct super_block *sb)
+{
+	struct hfsplus_sb_info *sbi = HFSPLUS_SB(sb);
+	int err;
+
+	sbi->kobj.kset = hfsplus_kset;
+	init_completion(&sbi->kobj_unregister);
+	err = kobject_init_and_add(&sbi->kobj, &hfsplus_sb_ktype, NULL,
+				   "%s", sb->s_id);
+	if (err) {
+		kobject_put(&sbi->kobj);
+		wait_for_completion(&sbi->kobj_unregister);
+	}
+
+	return err;
+}
+
+void hfsplus_unregister_sysfs(struct super_block *sb)
+{
+	struct hfsplus_sb_info *sbi = HFSPLUS_SB(sb);
+
+	kobject_del(&sbi->kobj);
+	kobject_put(&sbi->kobj);
+	wait_for_completion(&sbi->kobj_unregister);
+}
+
+int __init hfsplus_init_sysfs(void)
+{
+	hfsplus_kset = kset_create_and_add("hfsplus", NULL, fs_kobj);
+
+	return hfsplus_kset ? 0 : -ENOMEM;
+}
+
+void hfsplus_exit_sysfs(void)
+{
+	kset_unregister(hfsplus_kset);
+}
@@ -35,6 +35,44 @@
 #include "mft.h"
 #include "ntfs.h"
 
+/* Pages of $MFT to read at a time when a wanted mft record is not cached. */
+#define NTFS_MFT_READAHEAD_PAGES	16
+
+/**
+ * ntfs_mft_readahead - start reading $MFT around a page that is not cached
+ * @vol:	ntfs volume whose $MFT to read
+ * @index:	index into the page cache of $MFT of the wanted page
+ *
+ * Without readahead, walking a directory tree or reading many files reads
+ * the mft records one page at a time, each waited for before the next is
+ * requested.  Mft records of related files tend to be close together, so
+ * when the wanted page is not cached, read it and the following pages of
+ * $MFT in one go, growing the window while the accesses stay sequential.
+ * The multi sector transfer fixups are applied to each page as its read
+ * completes, see ntfs_end_buffer_async_read(), so they run concurrently on
+ * whichever cpus complete the i/o rather than in the reader.
+ *
+ * Readahead is disabled until the mount is complete as @vol->mft_ra is zero
+ * until then, and can be tuned or disabled through the read_ahead_kb of the
+ * underlying device.  The readahead state is shared and updated without
+ * locking, just like the one of a struct file shared by several tasks.
+ */
+static void ntfs_mft_readahead(ntfs_volume *vol, unsigned long index)
+{
+	struct address_space *mapping = vol->mft_ino->i_mapping;
+	struct page *page;
+
+	if (!vol->mft_ra.ra_pages)
+		return;
+	page = find_get_page(mapping, index);
+	if (page) {
+		put_page(page);
+		return;
+	}
+	page_cache_sync_readahead(mapping, &vol->mft_ra, NULL, index,
+			NTFS_MFT_READAHEAD_PAGES);
+}
+
 /**
  * map_mft_record_page - map the page in which a specific mft record resides
  * @ni:		ntfs inode whose mft record page to map
@@ -81,7 +119,8 @@ static inline MFT_RECORD *map_mft_record_page(ntfs_inode *ni)
 			goto err_out;
 		}
 	}
-	/* Read, map, and pin the page. */
+	/* Read ahead if needed, then read, map, and pin the page. */
+	ntfs_mft_readahead(vol, index);
 	page = ntfs_map_page(mft_vi->i_mapping, index);
 	if (likely(!IS_ERR(page))) {
 		/* Catch multi sector transfer fixup errors. */
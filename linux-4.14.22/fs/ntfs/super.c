@@ -2922,6 +2922,8 @@ static int ntfs_fill_super(struct super_block *sb, void *opt, const int silent)
 		}
 		mutex_unlock(&ntfs_lock);
 		sb->s_export_op = &ntfs_export_ops;
+		/* Now that $MFT is fully set up, allow readahead in it. */
+		file_ra_state_init(&vol->mft_ra, vol->mft_ino->i_mapping);
 		lockdep_on();
 		return 0;
 	}
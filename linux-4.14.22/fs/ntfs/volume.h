@@ -24,6 +24,7 @@
 #ifndef _LINUX_NTFS_VOLUME_H
 #define _LINUX_NTFS_VOLUME_H
 
+#include <linux/fs.h>
 #include <linux/rwsem.h>
 #include <linux/uidgid.h>
 
@@ -94,6 +95,8 @@ typedef struct {
 #endif /* NTFS_RW */
 
 	struct inode *mft_ino;		/* The VFS inode of $MFT. */
+	struct file_ra_state mft_ra;	/* Readahead state of $MFT, shared by
+					   all readers, see map_mft_record(). */
 
 	struct inode *mftbmp_ino;	/* Attribute inode for $MFT/$BITMAP. */
 	struct rw_semaphore mftbmp_lock; /* Lock for serializing accesses to the
@@ -52,12 +52,30 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/pagemap.h>
+#include <linux/hashtable.h>
+#include <linux/mutex.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
 #include "page_actor.h"
 
+/*
+ * Look-up block in the cache hash, called with the cache lock held.
+ */
+static struct squashfs_cache_entry *squashfs_cache_lookup(
+	struct squashfs_cache *cache, u64 block)
+{
+	struct squashfs_cache_entry *entry;
+
+	hash_for_each_possible(cache->hash, entry, hash, block)
+		if (entry->block == block)
+			return entry;
+
+	return NULL;
+}
+
+
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
  * and decompress it from disk.
@@ -65,21 +83,14 @@
 struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	struct squashfs_cache *cache, u64 block, int length)
 {
-	int i, n;
 	struct squashfs_cache_entry *entry;
 
 	spin_lock(&cache->lock);
 
 	while (1) {
-		for (i = cache->curr_blk, n = 0; n < cache->entries; n++) {
-			if (cache->entry[i].block == block) {
-				cache->curr_blk = i;
-				break;
-			}
-			i = (i + 1) % cache->entries;
-		}
+		entry = squashfs_cache_lookup(cache, block);
 
-		if (n == cache->entries) {
+		if (entry == NULL) {
 			/*
 			 * Block not in cache, if all cache entries are used
 			 * go to sleep waiting for one to become available.
@@ -94,19 +105,18 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  Unused entries
+			 * are kept in least recently used order, evict the
+			 * first one.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
+			entry = list_first_entry(&cache->lru,
+				struct squashfs_cache_entry, lru);
+			list_del_init(&entry->lru);
+			if (entry->block != SQUASHFS_INVALID_BLK) {
+				hash_del(&entry->hash);
+				cache->evictions++;
 			}
-
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
+			cache->misses++;
 
 			/*
 			 * Initialise chosen cache entry, and fill it in from
@@ -114,6 +124,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			 */
 			cache->unused--;
 			entry->block = block;
+			hash_add(cache->hash, &entry->hash, block);
 			entry->refcount = 1;
 			entry->pending = 1;
 			entry->num_waiters = 0;
@@ -150,9 +161,11 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * previously unused there's one less cache entry available
 		 * for reuse.
 		 */
-		entry = &cache->entry[i];
-		if (entry->refcount == 0)
+		cache->hits++;
+		if (entry->refcount == 0) {
 			cache->unused--;
+			list_del_init(&entry->lru);
+		}
 		entry->refcount++;
 
 		/*
@@ -170,8 +183,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	}
 
 out:
-	TRACE("Got %s %d, start block %lld, refcount %d, error %d\n",
-		cache->name, i, entry->block, entry->refcount, entry->error);
+	TRACE("Got %s block %lld, refcount %d, error %d\n",
+		cache->name, entry->block, entry->refcount, entry->error);
 
 	if (entry->error)
 		ERROR("Unable to read %s cache entry [%llx]\n", cache->name,
@@ -180,6 +193,20 @@ out:
 }
 
 
+static void squashfs_cache_entry_free(struct squashfs_cache_entry *entry)
+{
+	int i;
+
+	if (entry->data) {
+		for (i = 0; i < entry->cache->pages; i++)
+			kfree(entry->data[i]);
+		kfree(entry->data);
+	}
+	kfree(entry->actor);
+	kfree(entry);
+}
+
+
 /*
  * Release cache entry, once usage count is zero it can be reused.
  */
@@ -190,7 +217,20 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	spin_lock(&cache->lock);
 	entry->refcount--;
 	if (entry->refcount == 0) {
+		/*
+		 * The cache has been shrunk while this entry was in use,
+		 * drop it rather than making it available again.
+		 */
+		if (cache->entries > cache->size) {
+			hash_del(&entry->hash);
+			cache->entries--;
+			spin_unlock(&cache->lock);
+			squashfs_cache_entry_free(entry);
+			return;
+		}
+
 		cache->unused++;
+		list_add_tail(&entry->lru, &cache->lru);
 		/*
 		 * If there's any processes waiting for a block to become
 		 * available, wake one up.
@@ -209,34 +249,67 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
  */
 void squashfs_cache_delete(struct squashfs_cache *cache)
 {
-	int i, j;
+	struct squashfs_cache_entry *entry, *next;
 
 	if (cache == NULL)
 		return;
 
-	for (i = 0; i < cache->entries; i++) {
-		if (cache->entry[i].data) {
-			for (j = 0; j < cache->pages; j++)
-				kfree(cache->entry[i].data[j]);
-			kfree(cache->entry[i].data);
-		}
-		kfree(cache->entry[i].actor);
-	}
+	list_for_each_entry_safe(entry, next, &cache->lru, lru)
+		squashfs_cache_entry_free(entry);
 
-	kfree(cache->entry);
 	kfree(cache);
 }
 
 
+/*
+ * Allocate a cache entry of cache->block_size.  To avoid vmalloc
+ * fragmentation issues each entry is allocated as a sequence of kmalloced
+ * PAGE_SIZE buffers.
+ */
+static struct squashfs_cache_entry *squashfs_cache_entry_alloc(
+	struct squashfs_cache *cache)
+{
+	int i;
+	struct squashfs_cache_entry *entry = kzalloc(sizeof(*entry),
+		GFP_KERNEL);
+
+	if (entry == NULL)
+		return NULL;
+
+	init_waitqueue_head(&entry->wait_queue);
+	INIT_LIST_HEAD(&entry->lru);
+	entry->cache = cache;
+	entry->block = SQUASHFS_INVALID_BLK;
+	entry->data = kcalloc(cache->pages, sizeof(void *), GFP_KERNEL);
+	if (entry->data == NULL)
+		goto cleanup;
+
+	for (i = 0; i < cache->pages; i++) {
+		entry->data[i] = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		if (entry->data[i] == NULL)
+			goto cleanup;
+	}
+
+	entry->actor = squashfs_page_actor_init(entry->data, cache->pages, 0);
+	if (entry->actor == NULL)
+		goto cleanup;
+
+	return entry;
+
+cleanup:
+	squashfs_cache_entry_free(entry);
+	return NULL;
+}
+
+
 /*
  * Initialise cache allocating the specified number of entries, each of
- * size block_size.  To avoid vmalloc fragmentation issues each entry
- * is allocated as a sequence of kmalloced PAGE_SIZE buffers.
+ * size block_size.
  */
 struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	int block_size)
 {
-	int i, j;
+	int i;
 	struct squashfs_cache *cache = kzalloc(sizeof(*cache), GFP_KERNEL);
 
 	if (cache == NULL) {
@@ -244,52 +317,29 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		return NULL;
 	}
 
-	cache->entry = kcalloc(entries, sizeof(*(cache->entry)), GFP_KERNEL);
-	if (cache->entry == NULL) {
-		ERROR("Failed to allocate %s cache\n", name);
-		goto cleanup;
-	}
-
-	cache->curr_blk = 0;
-	cache->next_blk = 0;
-	cache->unused = entries;
-	cache->entries = entries;
 	cache->block_size = block_size;
 	cache->pages = block_size >> PAGE_SHIFT;
 	cache->pages = cache->pages ? cache->pages : 1;
 	cache->name = name;
 	cache->num_waiters = 0;
 	spin_lock_init(&cache->lock);
+	mutex_init(&cache->resize_mutex);
 	init_waitqueue_head(&cache->wait_queue);
+	INIT_LIST_HEAD(&cache->lru);
+	hash_init(cache->hash);
 
 	for (i = 0; i < entries; i++) {
-		struct squashfs_cache_entry *entry = &cache->entry[i];
-
-		init_waitqueue_head(&cache->entry[i].wait_queue);
-		entry->cache = cache;
-		entry->block = SQUASHFS_INVALID_BLK;
-		entry->data = kcalloc(cache->pages, sizeof(void *), GFP_KERNEL);
-		if (entry->data == NULL) {
-			ERROR("Failed to allocate %s cache entry\n", name);
-			goto cleanup;
-		}
+		struct squashfs_cache_entry *entry;
 
-		for (j = 0; j < cache->pages; j++) {
-			entry->data[j] = kmalloc(PAGE_SIZE, GFP_KERNEL);
-			if (entry->data[j] == NULL) {
-				ERROR("Failed to allocate %s buffer\n", name);
-				goto cleanup;
-			}
-		}
-
-		entry->actor = squashfs_page_actor_init(entry->data,
-						cache->pages, 0);
-		if (entry->actor == NULL) {
+		entry = squashfs_cache_entry_alloc(cache);
+		if (entry == NULL) {
 			ERROR("Failed to allocate %s cache entry\n", name);
 			goto cleanup;
 		}
+		list_add_tail(&entry->lru, &cache->lru);
 	}
 
+	cache->entries = cache->unused = cache->size = entries;
 	return cache;
 
 cleanup:
@@ -298,6 +348,60 @@ cleanup:
 }
 
 
+/*
+ * Change the number of entries in the cache.  Growing takes effect
+ * immediately, shrinking frees unused entries now and entries which are
+ * in use once they are released.
+ */
+int squashfs_cache_resize(struct squashfs_cache *cache, int entries)
+{
+	struct squashfs_cache_entry *entry, *next;
+	LIST_HEAD(free);
+	int err = 0;
+
+	if (entries < 1 || entries > SQUASHFS_CACHE_MAX_ENTRIES)
+		return -EINVAL;
+
+	mutex_lock(&cache->resize_mutex);
+
+	spin_lock(&cache->lock);
+	cache->size = entries;
+	while (cache->entries > cache->size && cache->unused) {
+		entry = list_first_entry(&cache->lru,
+			struct squashfs_cache_entry, lru);
+		list_move(&entry->lru, &free);
+		if (entry->block != SQUASHFS_INVALID_BLK)
+			hash_del(&entry->hash);
+		cache->unused--;
+		cache->entries--;
+	}
+
+	while (cache->entries < cache->size) {
+		spin_unlock(&cache->lock);
+		entry = squashfs_cache_entry_alloc(cache);
+		spin_lock(&cache->lock);
+		if (entry == NULL) {
+			err = -ENOMEM;
+			break;
+		}
+
+		list_add(&entry->lru, &cache->lru);
+		cache->unused++;
+		cache->entries++;
+		if (cache->num_waiters)
+			wake_up(&cache->wait_queue);
+	}
+	spin_unlock(&cache->lock);
+
+	mutex_unlock(&cache->resize_mutex);
+
+	list_for_each_entry_safe(entry, next, &free, lru)
+		squashfs_cache_entry_free(entry);
+
+	return err;
+}
+
+
 /*
  * Copy up to length bytes from cache entry to buffer starting at offset bytes
  * into the cache entry.  If there's not length bytes then copy the number of
@@ -0,0 +1,172 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2. See
+ * the COPYING file in the top-level directory.
+ *
+ * file_readahead.c
+ */
+
+/*
+ * Readahead normally ends up calling squashfs_readpage() for one page per
+ * datablock, one after the other in the reader's context, so a sequential
+ * read of a large file decompresses on a single core no matter how many
+ * decompressors are available.
+ *
+ * Instead, squashfs_readpages() inserts one page per datablock into the
+ * page cache and hands all but the first to an unbound workqueue, which
+ * fills them (and the rest of their datablock) in parallel. The first
+ * datablock, the one the reader is most likely waiting for, is read
+ * directly.
+ *
+ * Only the first page of a datablock is read, so the readahead marker,
+ * which starts the next readahead when the reader gets to it, is moved
+ * from the other pages to the page read for their datablock.
+ *
+ * A worker unlocks its pages before it is done with the superblock's
+ * caches, so waiting for the page locks doesn't wait for the workers:
+ * squashfs_put_super() waits for the superblock's pending work instead.
+ */
+
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/pagemap.h>
+#include <linux/mm_inline.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+
+struct squashfs_readahead_work {
+	struct work_struct	work;
+	struct page		*page;
+	struct squashfs_sb_info	*msblk;
+};
+
+static struct workqueue_struct *squashfs_readahead_wq;
+
+static void squashfs_readahead_fn(struct work_struct *work)
+{
+	struct squashfs_readahead_work *ra = container_of(work,
+		struct squashfs_readahead_work, work);
+
+	struct squashfs_sb_info *msblk = ra->msblk;
+	unsigned long flags;
+
+	squashfs_readpage(NULL, ra->page);
+	put_page(ra->page);
+	kfree(ra);
+
+	/* msblk may be freed as soon as the lock is dropped */
+	spin_lock_irqsave(&msblk->readahead_wait.lock, flags);
+	if (!--msblk->readahead_pending)
+		wake_up_locked(&msblk->readahead_wait);
+	spin_unlock_irqrestore(&msblk->readahead_wait.lock, flags);
+}
+
+static void squashfs_readahead_queue(struct file *file,
+	struct squashfs_sb_info *msblk, struct page *page)
+{
+	struct squashfs_readahead_work *ra;
+
+	ra = kmalloc(sizeof(*ra), GFP_NOFS);
+	if (!ra) {
+		squashfs_readpage(file, page);
+		put_page(page);
+		return;
+	}
+
+	INIT_WORK(&ra->work, squashfs_readahead_fn);
+	ra->page = page;
+	ra->msblk = msblk;
+	spin_lock_irq(&msblk->readahead_wait.lock);
+	msblk->readahead_pending++;
+	spin_unlock_irq(&msblk->readahead_wait.lock);
+	queue_work(squashfs_readahead_wq, &ra->work);
+}
+
+int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned int nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	struct page *first = NULL, *cur = NULL;
+	pgoff_t last = ULONG_MAX;
+	bool mark = false;
+
+	/*
+	 * The list is in descending index order, take pages from the tail.
+	 * The page read for a datablock is only queued once all the pages
+	 * of the datablock have been seen, so that it can take their marker.
+	 */
+	while (!list_empty(pages)) {
+		struct page *page = lru_to_page(pages);
+
+		list_del(&page->lru);
+
+		/*
+		 * The other pages of a datablock are filled in by the read
+		 * of its first page, see squashfs_copy_cache()
+		 */
+		if (page->index >> shift == last ||
+				add_to_page_cache_lru(page, mapping,
+				page->index, readahead_gfp_mask(mapping))) {
+			if (PageReadahead(page)) {
+				if (page->index >> shift == last)
+					SetPageReadahead(cur);
+				else
+					mark = true;
+			}
+			put_page(page);
+			continue;
+		}
+		last = page->index >> shift;
+
+		if (mark) {
+			SetPageReadahead(page);
+			mark = false;
+		}
+
+		if (cur && cur != first)
+			squashfs_readahead_queue(file, msblk, cur);
+		if (!first)
+			first = page;
+		cur = page;
+	}
+
+	if (cur && cur != first)
+		squashfs_readahead_queue(file, msblk, cur);
+
+	if (first) {
+		squashfs_readpage(file, first);
+		put_page(first);
+	}
+
+	return 0;
+}
+
+/* Wait for the readahead work still using the superblock's caches */
+void squashfs_readahead_drain(struct squashfs_sb_info *msblk)
+{
+	spin_lock_irq(&msblk->readahead_wait.lock);
+	wait_event_lock_irq(msblk->readahead_wait, !msblk->readahead_pending,
+			    msblk->readahead_wait.lock);
+	spin_unlock_irq(&msblk->readahead_wait.lock);
+}
+
+int __init squashfs_readahead_init(void)
+{
+	squashfs_readahead_wq = alloc_workqueue("squashfs_ra", WQ_UNBOUND, 0);
+
+	return squashfs_readahead_wq ? 0 : -ENOMEM;
+}
+
+void squashfs_readahead_destroy(void)
+{
+	destroy_workqueue(squashfs_readahead_wq);
+}
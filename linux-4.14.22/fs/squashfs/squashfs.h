@@ -37,6 +37,7 @@ extern void squashfs_cache_delete(struct squashfs_cache *);
 extern struct squashfs_cache_entry *squashfs_cache_get(struct super_block *,
 				struct squashfs_cache *, u64, int);
 extern void squashfs_cache_put(struct squashfs_cache_entry *);
+extern int squashfs_cache_resize(struct squashfs_cache *, int);
 extern int squashfs_copy_data(void *, struct squashfs_cache_entry *, int, int);
 extern int squashfs_read_metadata(struct super_block *, void *, u64 *,
 				int *, int);
@@ -69,6 +70,29 @@ extern __le64 *squashfs_read_fragment_index_table(struct super_block *,
 /* file.c */
 void squashfs_copy_cache(struct page *, struct squashfs_cache_entry *, int,
 				int);
+extern int squashfs_readpage(struct file *, struct page *);
+
+/* file_readahead.c */
+#ifdef CONFIG_SQUASHFS_READAHEAD_PARALLEL
+extern int squashfs_readpages(struct file *, struct address_space *,
+				struct list_head *, unsigned int);
+extern void squashfs_readahead_drain(struct squashfs_sb_info *);
+extern int squashfs_readahead_init(void);
+extern void squashfs_readahead_destroy(void);
+#else
+static inline void squashfs_readahead_drain(struct squashfs_sb_info *msblk)
+{
+}
+
+static inline int squashfs_readahead_init(void)
+{
+	return 0;
+}
+
+static inline void squashfs_readahead_destroy(void)
+{
+}
+#endif
 
 /* file_xxx.c */
 extern int squashfs_readpage_block(struct page *, u64, int);
@@ -83,6 +107,12 @@ extern struct inode *squashfs_iget(struct super_block *, long long,
 				unsigned int);
 extern int squashfs_read_inode(struct inode *, long long);
 
+/* sysfs.c */
+extern int squashfs_register_sysfs(struct super_block *);
+extern void squashfs_unregister_sysfs(struct super_block *);
+extern int squashfs_init_sysfs(void);
+extern void squashfs_exit_sysfs(void);
+
 /* xattr.c */
 extern ssize_t squashfs_listxattr(struct dentry *, char *, size_t);
 
@@ -23,20 +23,31 @@
  * squashfs_fs_sb.h
  */
 
+#include <linux/hashtable.h>
+#include <linux/kobject.h>
+#include <linux/completion.h>
+
 #include "squashfs_fs.h"
 
+#define SQUASHFS_CACHE_HASH_BITS	6
+#define SQUASHFS_CACHE_MAX_ENTRIES	1024
+
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			curr_blk;
-	int			next_blk;
+	int			size;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
 	int			pages;
 	spinlock_t		lock;
+	struct mutex		resize_mutex;
 	wait_queue_head_t	wait_queue;
-	struct squashfs_cache_entry *entry;
+	struct list_head	lru;
+	DECLARE_HASHTABLE(hash, SQUASHFS_CACHE_HASH_BITS);
+	u64			hits;
+	u64			misses;
+	u64			evictions;
 };
 
 struct squashfs_cache_entry {
@@ -49,6 +60,8 @@ struct squashfs_cache_entry {
 	int			num_waiters;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache	*cache;
+	struct list_head	lru;
+	struct hlist_node	hash;
 	void			**data;
 	struct squashfs_page_actor	*actor;
 };
@@ -76,5 +89,9 @@ struct squashfs_sb_info {
 	long long				bytes_used;
 	unsigned int				inodes;
 	int					xattr_ids;
+	struct kobject				kobj;
+	struct completion			kobj_unregister;
+	int					readahead_pending;
+	wait_queue_head_t			readahead_wait;
 };
 #endif
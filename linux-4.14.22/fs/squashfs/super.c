@@ -100,6 +100,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
 	mutex_init(&msblk->meta_index_mutex);
+	init_waitqueue_head(&msblk->readahead_wait);
 
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
@@ -329,6 +330,13 @@ check_directory_table:
 		goto failed_mount;
 	}
 
+	err = squashfs_register_sysfs(sb);
+	if (err) {
+		dput(sb->s_root);
+		sb->s_root = NULL;
+		goto failed_mount;
+	}
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -382,6 +390,8 @@ static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		squashfs_readahead_drain(sbi);
+		squashfs_unregister_sysfs(sb);
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
@@ -444,8 +454,23 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	err = squashfs_readahead_init();
+	if (err) {
+		destroy_inodecache();
+		return err;
+	}
+
+	err = squashfs_init_sysfs();
+	if (err) {
+		squashfs_readahead_destroy();
+		destroy_inodecache();
+		return err;
+	}
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		squashfs_exit_sysfs();
+		squashfs_readahead_destroy();
 		destroy_inodecache();
 		return err;
 	}
@@ -459,6 +484,8 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	squashfs_exit_sysfs();
+	squashfs_readahead_destroy();
 	destroy_inodecache();
 }
 
@@ -0,0 +1,187 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * sysfs.c
+ */
+
+/*
+ * Per-mount fragment and metadata cache tunables and statistics, in
+ * /sys/fs/squashfs/<device>/.  The <cache>_cache_size files can be
+ * written to resize a cache at runtime, the hit, miss and eviction
+ * counters are read-only.
+ */
+
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/spinlock.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs.h"
+
+enum {
+	cache_size,
+	cache_hits,
+	cache_misses,
+	cache_evictions,
+};
+
+struct squashfs_attr {
+	struct attribute	attr;
+	int			cache;
+	int			id;
+};
+
+#define SQUASHFS_CACHE_ATTR(_name, _member, _id, _mode)			\
+static struct squashfs_attr squashfs_attr_##_name##_##_id = {		\
+	.attr = { .name = __stringify(_name) "_" #_id, .mode = _mode },	\
+	.cache = offsetof(struct squashfs_sb_info, _member),		\
+	.id = cache_##_id,						\
+}
+
+#define SQUASHFS_CACHE_ATTRS(_name, _member)				\
+	SQUASHFS_CACHE_ATTR(_name, _member, size, 0644);		\
+	SQUASHFS_CACHE_ATTR(_name, _member, hits, 0444);		\
+	SQUASHFS_CACHE_ATTR(_name, _member, misses, 0444);		\
+	SQUASHFS_CACHE_ATTR(_name, _member, evictions, 0444)
+
+#define ATTR_LIST(_name, _id)	(&squashfs_attr_##_name##_##_id.attr)
+
+SQUASHFS_CACHE_ATTRS(fragment_cache, fragment_cache);
+SQUASHFS_CACHE_ATTRS(metadata_cache, block_cache);
+
+static struct attribute *squashfs_attrs[] = {
+	ATTR_LIST(fragment_cache, size),
+	ATTR_LIST(fragment_cache, hits),
+	ATTR_LIST(fragment_cache, misses),
+	ATTR_LIST(fragment_cache, evictions),
+	ATTR_LIST(metadata_cache, size),
+	ATTR_LIST(metadata_cache, hits),
+	ATTR_LIST(metadata_cache, misses),
+	ATTR_LIST(metadata_cache, evictions),
+	NULL,
+};
+
+static struct squashfs_cache *squashfs_attr_cache(struct kobject *kobj,
+	struct squashfs_attr *a)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, kobj);
+
+	return *(struct squashfs_cache **) ((char *) msblk + a->cache);
+}
+
+static ssize_t squashfs_attr_show(struct kobject *kobj,
+	struct attribute *attr, char *buf)
+{
+	struct squashfs_attr *a = container_of(attr, struct squashfs_attr, attr);
+	struct squashfs_cache *cache = squashfs_attr_cache(kobj, a);
+	u64 val = 0;
+
+	/* The fragment cache only exists if the filesystem has fragments */
+	if (cache == NULL)
+		return sprintf(buf, "0\n");
+
+	spin_lock(&cache->lock);
+	switch (a->id) {
+	case cache_size:
+		val = cache->size;
+		break;
+	case cache_hits:
+		val = cache->hits;
+		break;
+	case cache_misses:
+		val = cache->misses;
+		break;
+	case cache_evictions:
+		val = cache->evictions;
+		break;
+	}
+	spin_unlock(&cache->lock);
+
+	return sprintf(buf, "%llu\n", val);
+}
+
+static ssize_t squashfs_attr_store(struct kobject *kobj,
+	struct attribute *attr, const char *buf, size_t len)
+{
+	struct squashfs_attr *a = container_of(attr, struct squashfs_attr, attr);
+	struct squashfs_cache *cache = squashfs_attr_cache(kobj, a);
+	int entries, err;
+
+	if (a->id != cache_size || cache == NULL)
+		return -EINVAL;
+
+	err = kstrtoint(buf, 0, &entries);
+	if (err)
+		return err;
+
+	err = squashfs_cache_resize(cache, entries);
+	return err ? err : len;
+}
+
+static void squashfs_sb_release(struct kobject *kobj)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, kobj);
+
+	complete(&msblk->kobj_unregister);
+}
+
+static const struct sysfs_ops squashfs_attr_ops = {
+	.show	= squashfs_attr_show,
+	.store	= squashfs_attr_store,
+};
+
+static struct kobj_type squashfs_sb_ktype = {
+	.default_attrs	= squashfs_attrs,
+	.sysfs_ops	= &squashfs_attr_ops,
+	.release	= squashfs_sb_release,
+};
+
+static struct kset *squashfs_kset;
+
+int squashfs_register_sysfs(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int err;
+
+	msblk->kobj.kset = squashfs_kset;
+	init_completion(&msblk->kobj_unregister);
+	err = kobject_init_and_add(&msblk->kobj, &squashfs_sb_ktype, NULL,
+		"%s", sb->s_id);
+	if (err) {
+		kobject_put(&msblk->kobj);
+		wait_for_completion(&msblk->kobj_unregister);
+	}
+
+	return err;
+}
+
+void squashfs_unregister_sysfs(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	kobject_del(&msblk->kobj);
+	kobject_put(&msblk->kobj);
+	wait_for_completion(&msblk->kobj_unregister);
+}
+
+int __init squashfs_init_sysfs(void)
+{
+	squashfs_kset = kset_create_and_add("squashfs", NULL, fs_kobj);
+
+	return squashfs_kset ? 0 : -ENOMEM;
+}
+
+void squashfs_exit_sysfs(void)
+{
+	kset_unregister(squashfs_kset);
+}
@@ -18,7 +18,13 @@ struct chacha20_ctx {
 	u32 key[8];
 };
 
+/* Returns the number of blocks generated, from the start of stream. */
+typedef unsigned int (*chacha20_blocks_fn_t)(u32 *state, u8 *stream,
+					     unsigned int nblocks);
+
 void chacha20_block(u32 *state, void *stream);
+void chacha20_blocks(u32 *state, u8 *stream, unsigned int nblocks);
+void chacha20_register_blocks(chacha20_blocks_fn_t fn);
 void crypto_chacha20_init(u32 *state, struct chacha20_ctx *ctx, u8 *iv);
 int crypto_chacha20_setkey(struct crypto_skcipher *tfm, const u8 *key,
 			   unsigned int keysize);
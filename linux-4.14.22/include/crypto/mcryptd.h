@@ -15,6 +15,9 @@
 #include <linux/kernel.h>
 #include <crypto/hash.h>
 
+/* Widest lane manager accounted by mcryptd_account_lanes(). */
+#define MCRYPTD_MAX_LANES	16
+
 struct mcryptd_ahash {
 	struct crypto_ahash base;
 };
@@ -109,6 +112,14 @@ static inline unsigned long get_delay(unsigned long t)
 		return (unsigned long) delay;
 }
 
+/*
+ * Multi-buffer algorithms compute the deadline of a job as
+ * jiffies + mcryptd_flush_interval(<their interval>), so that the delay
+ * set in debugfs applies to jobs as well as to the flush work, and report
+ * the lane occupancy of their lane manager with mcryptd_account_lanes().
+ */
 void mcryptd_arm_flusher(struct mcryptd_alg_cstate *cstate, unsigned long delay);
+unsigned long mcryptd_flush_interval(unsigned long interval);
+void mcryptd_account_lanes(unsigned int in_use, unsigned int nr_lanes);
 
 #endif
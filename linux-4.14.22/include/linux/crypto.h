@@ -438,6 +438,9 @@ struct compress_alg {
  * @cra_list: internally used
  * @cra_users: internally used
  * @cra_refcnt: internally used
+ * @cra_test_nsecs: internally used
+ * @cra_test_err: internally used
+ * @cra_tests_pending: internally used
  * @cra_destroy: internally used
  *
  * The struct crypto_alg describes a generic Crypto API algorithm and is common
@@ -456,6 +459,10 @@ struct crypto_alg {
 	int cra_priority;
 	atomic_t cra_refcnt;
 
+	u64 cra_test_nsecs;
+	int cra_test_err;
+	atomic_t cra_tests_pending;
+
 	char cra_name[CRYPTO_MAX_ALG_NAME];
 	char cra_driver_name[CRYPTO_MAX_ALG_NAME];
 
@@ -52,6 +52,14 @@ int request_firmware_into_buf(const struct firmware **firmware_p,
 	const char *name, struct device *device, void *buf, size_t size);
 
 void release_firmware(const struct firmware *fw);
+
+#ifdef CONFIG_FW_LOADER_ROOTFS_INDEX
+void firmware_rootfs_add(const char *path);
+#else
+static inline void firmware_rootfs_add(const char *path)
+{
+}
+#endif
 #else
 static inline int request_firmware(const struct firmware **fw,
 				   const char *name,
@@ -84,5 +92,9 @@ static inline int request_firmware_into_buf(const struct firmware **firmware_p,
 	return -EINVAL;
 }
 
+static inline void firmware_rootfs_add(const char *path)
+{
+}
+
 #endif
 #endif
@@ -22,3 +22,15 @@ extern unsigned long initrd_start, initrd_end;
 extern void free_initrd_mem(unsigned long, unsigned long);
 
 extern unsigned int real_root_dev;
+
+#ifdef CONFIG_INITRAMFS_SQUASHFS
+extern bool squashfs_root_claim(char *buf, unsigned long len, bool builtin);
+extern void squashfs_root_mount(void);
+#else
+static inline bool squashfs_root_claim(char *buf, unsigned long len,
+				       bool builtin)
+{
+	return false;
+}
+static inline void squashfs_root_mount(void) { }
+#endif
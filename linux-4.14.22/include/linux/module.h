@@ -370,6 +370,11 @@ struct module {
 	const s32 *unused_gpl_crcs;
 #endif
 
+#ifdef CONFIG_MODULE_SYMBOL_HASH
+	/* Exported symbols, as linked in the global symbol hash */
+	struct ksym_table *ksym_table;
+#endif
+
 #ifdef CONFIG_MODULE_SIG
 	/* Signature was verified. */
 	bool sig_ok;
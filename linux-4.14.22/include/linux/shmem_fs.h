@@ -132,6 +132,29 @@ static inline bool shmem_huge_enabled(struct vm_area_struct *vma)
 }
 #endif
 
+#ifdef CONFIG_SHMEM_COMPRESS
+extern bool shmem_compress_enabled(void);
+extern swp_entry_t shmem_compress_store(struct page *page);
+extern int shmem_compress_load(swp_entry_t entry, struct page *page);
+extern void shmem_compress_free(swp_entry_t entry);
+#else
+static inline bool shmem_compress_enabled(void)
+{
+	return false;
+}
+static inline swp_entry_t shmem_compress_store(struct page *page)
+{
+	return (swp_entry_t) { 0 };
+}
+static inline int shmem_compress_load(swp_entry_t entry, struct page *page)
+{
+	return -EIO;
+}
+static inline void shmem_compress_free(swp_entry_t entry)
+{
+}
+#endif
+
 #ifdef CONFIG_SHMEM
 extern int shmem_mcopy_atomic_pte(struct mm_struct *dst_mm, pmd_t *dst_pmd,
 				  struct vm_area_struct *dst_vma,
@@ -89,9 +89,22 @@ static inline int current_is_kswapd(void)
 #define SWP_HWPOISON_NUM 0
 #endif
 
+/*
+ * tmpfs pages compressed in memory: the offset identifies the compressed
+ * copy, see mm/shmem_compress.c.  Only ever found in a shmem mapping's
+ * page cache, never in a pte.
+ */
+#ifdef CONFIG_SHMEM_COMPRESS
+#define SWP_SHMEM_COMPRESS_NUM 1
+#define SWP_SHMEM_COMPRESS \
+	(MAX_SWAPFILES + SWP_HWPOISON_NUM + SWP_MIGRATION_NUM + SWP_DEVICE_NUM)
+#else
+#define SWP_SHMEM_COMPRESS_NUM 0
+#endif
+
 #define MAX_SWAPFILES \
 	((1 << MAX_SWAPFILES_SHIFT) - SWP_DEVICE_NUM - \
-	SWP_MIGRATION_NUM - SWP_HWPOISON_NUM)
+	SWP_MIGRATION_NUM - SWP_HWPOISON_NUM - SWP_SHMEM_COMPRESS_NUM)
 
 /*
  * Magic header for a swap area. The first part of the union is
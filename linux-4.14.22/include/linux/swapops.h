@@ -377,7 +377,20 @@ static inline void num_poisoned_pages_inc(void)
 }
 #endif
 
-#if defined(CONFIG_MEMORY_FAILURE) || defined(CONFIG_MIGRATION)
+#ifdef CONFIG_SHMEM_COMPRESS
+static inline int is_shmem_compress_entry(swp_entry_t entry)
+{
+	return swp_type(entry) == SWP_SHMEM_COMPRESS;
+}
+#else
+static inline int is_shmem_compress_entry(swp_entry_t entry)
+{
+	return 0;
+}
+#endif
+
+#if defined(CONFIG_MEMORY_FAILURE) || defined(CONFIG_MIGRATION) || \
+	defined(CONFIG_SHMEM_COMPRESS)
 static inline int non_swap_entry(swp_entry_t entry)
 {
 	return swp_type(entry) >= MAX_SWAPFILES;
@@ -51,6 +51,8 @@ int zpool_malloc(struct zpool *pool, size_t size, gfp_t gfp,
 
 void zpool_free(struct zpool *pool, unsigned long handle);
 
+unsigned long zpool_compact(struct zpool *pool);
+
 int zpool_shrink(struct zpool *pool, unsigned int pages,
 			unsigned int *reclaimed);
 
@@ -96,6 +98,7 @@ struct zpool_driver {
 
 	int (*shrink)(void *pool, unsigned int pages,
 				unsigned int *reclaimed);
+	unsigned long (*compact)(void *pool);
 
 	void *(*map)(void *pool, unsigned long handle,
 				enum zpool_mapmode mm);
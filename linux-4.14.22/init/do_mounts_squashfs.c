@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Boot from a squashfs initramfs without unpacking it.
+ *
+ * If the built in initramfs or the bootloader supplied initrd is a
+ * squashfs image rather than a cpio archive, populate_rootfs() leaves it
+ * alone and it is exposed read-only as /dev/initsqfs, straight from the
+ * memory it was loaded into. Once all initcalls have run, it is mounted
+ * under a tmpfs upper layer with overlayfs and the result is moved over /.
+ * Files are then only decompressed when first read.
+ *
+ * Many of the syscalls used in this file expect some of the arguments
+ * to be __user pointers not __kernel pointers.  To limit the sparse
+ * noise, turn off sparse checking for this file.
+ */
+#ifdef __CHECKER__
+#undef __CHECKER__
+#warning "Sparse checking disabled for this file"
+#endif
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/bio.h>
+#include <linux/genhd.h>
+#include <linux/highmem.h>
+#include <linux/vmalloc.h>
+#include <linux/initrd.h>
+#include <linux/major.h>
+#include <linux/magic.h>
+#include <asm/unaligned.h>
+
+#include "do_mounts.h"
+
+#define SQFS_ROOT	"/.initsqfs"
+
+/* The image stays in use for as long as the root file system is mounted */
+static const void *sqfs_image;
+static unsigned long sqfs_size;
+
+static blk_qc_t sqfs_make_request(struct request_queue *q, struct bio *bio)
+{
+	sector_t sector = bio->bi_iter.bi_sector;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+
+	if (op_is_write(bio_op(bio)) ||
+	    bio_end_sector(bio) > get_capacity(bio->bi_disk))
+		goto io_error;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		void *dst = kmap_atomic(bvec.bv_page);
+
+		memcpy(dst + bvec.bv_offset,
+		       sqfs_image + (sector << SECTOR_SHIFT), bvec.bv_len);
+		kunmap_atomic(dst);
+		sector += bvec.bv_len >> SECTOR_SHIFT;
+	}
+
+	bio_endio(bio);
+	return BLK_QC_T_NONE;
+io_error:
+	bio_io_error(bio);
+	return BLK_QC_T_NONE;
+}
+
+static const struct block_device_operations sqfs_fops = {
+	.owner =	THIS_MODULE,
+};
+
+/*
+ * Called from populate_rootfs() for the built in initramfs and for the
+ * initrd. Returns true if @buf is a squashfs image, which then must not
+ * be unpacked or freed.
+ */
+bool __init squashfs_root_claim(char *buf, unsigned long len, bool builtin)
+{
+	if (sqfs_image || len < 4 || get_unaligned_le32(buf) != SQUASHFS_MAGIC)
+		return false;
+
+	if (builtin) {
+		/*
+		 * .init.ramfs is freed with the rest of the init sections,
+		 * so keep a copy. This is the compressed image, a fraction
+		 * of what unpacking it would have taken.
+		 */
+		sqfs_image = vmalloc(len);
+		if (!sqfs_image)
+			panic("Cannot allocate %lu bytes for initramfs\n", len);
+		memcpy((void *)sqfs_image, buf, len);
+
+		/* the console is opened before the image is mounted */
+		sys_mkdir("/dev", 0755);
+		sys_mknod("/dev/console", S_IFCHR | 0600,
+			  new_encode_dev(MKDEV(TTYAUX_MAJOR, 1)));
+	} else {
+		sqfs_image = buf;
+	}
+	sqfs_size = len;
+
+	printk(KERN_INFO "initramfs is a squashfs image (%lu bytes), mounting it later\n",
+	       len);
+	return true;
+}
+
+static int __init sqfs_add_disk(dev_t *devt)
+{
+	struct request_queue *queue;
+	struct gendisk *disk;
+	int major;
+
+	major = register_blkdev(0, "initsqfs");
+	if (major < 0)
+		return major;
+
+	queue = blk_alloc_queue(GFP_KERNEL);
+	if (!queue)
+		goto out_unregister;
+	blk_queue_make_request(queue, sqfs_make_request);
+
+	disk = alloc_disk(1);
+	if (!disk)
+		goto out_queue;
+
+	disk->major = major;
+	disk->first_minor = 0;
+	disk->fops = &sqfs_fops;
+	disk->queue = queue;
+	disk->flags |= GENHD_FL_SUPPRESS_PARTITION_INFO;
+	strcpy(disk->disk_name, "initsqfs");
+	set_capacity(disk, sqfs_size >> SECTOR_SHIFT);
+	set_disk_ro(disk, 1);
+	add_disk(disk);
+
+	*devt = disk_devt(disk);
+	return 0;
+
+out_queue:
+	blk_cleanup_queue(queue);
+out_unregister:
+	unregister_blkdev(major, "initsqfs");
+	return -ENOMEM;
+}
+
+/*
+ * Called from kernel_init_freeable() once all initcalls have run: mount the
+ * claimed image as the lower layer of an overlay and make that the root.
+ * On failure the rootfs is left as is and the normal root= handling runs.
+ */
+void __init squashfs_root_mount(void)
+{
+	dev_t devt;
+	int err;
+
+	if (!sqfs_image)
+		return;
+
+	err = sqfs_add_disk(&devt);
+	if (err)
+		goto out;
+
+	create_dev("/dev/initsqfs", devt);
+	sys_mkdir(SQFS_ROOT, 0700);
+	sys_mkdir(SQFS_ROOT "/lower", 0700);
+	sys_mkdir(SQFS_ROOT "/rw", 0700);
+	sys_mkdir(SQFS_ROOT "/root", 0755);
+
+	err = sys_mount("/dev/initsqfs", SQFS_ROOT "/lower", "squashfs",
+			MS_RDONLY, NULL);
+	if (err)
+		goto out;
+
+	err = sys_mount("tmpfs", SQFS_ROOT "/rw", "tmpfs", 0, "mode=0755");
+	if (err)
+		goto out;
+	sys_mkdir(SQFS_ROOT "/rw/upper", 0755);
+	sys_mkdir(SQFS_ROOT "/rw/work", 0755);
+
+	err = sys_mount("overlay", SQFS_ROOT "/root", "overlay", 0,
+			"lowerdir=" SQFS_ROOT "/lower,"
+			"upperdir=" SQFS_ROOT "/rw/upper,"
+			"workdir=" SQFS_ROOT "/rw/work");
+	if (err)
+		goto out;
+
+	sys_chdir(SQFS_ROOT "/root");
+	sys_mount(".", "/", NULL, MS_MOVE, NULL);
+	sys_chroot(".");
+	return;
+out:
+	pr_err("Cannot mount squashfs initramfs: %d\n", err);
+}
@@ -20,6 +20,7 @@
 #include <linux/syscalls.h>
 #include <linux/utime.h>
 #include <linux/file.h>
+#include <linux/firmware.h>
 
 static ssize_t __init xwrite(int fd, const char *p, size_t count)
 {
@@ -375,6 +376,7 @@ static int __init do_copy(void)
 			error("write error");
 		sys_close(wfd);
 		do_utime(vcollected, mtime);
+		firmware_rootfs_add(vcollected);
 		kfree(vcollected);
 		eat(body_len);
 		state = SkipIt;
@@ -609,12 +611,17 @@ static void __init clean_rootfs(void)
 
 static int __init populate_rootfs(void)
 {
-	/* Load the built in initramfs */
-	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
+	char *err = NULL;
+
+	/* Load the built in initramfs, unless it is to be mounted instead */
+	if (!squashfs_root_claim(__initramfs_start, __initramfs_size, true))
+		err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
 	if (err)
 		panic("%s", err); /* Failed to decompress INTERNAL initramfs */
 	/* If available load the bootloader supplied initrd */
-	if (initrd_start && !IS_ENABLED(CONFIG_INITRAMFS_FORCE)) {
+	if (initrd_start && !IS_ENABLED(CONFIG_INITRAMFS_FORCE) &&
+	    !squashfs_root_claim((char *)initrd_start,
+				 initrd_end - initrd_start, false)) {
 #ifdef CONFIG_BLK_DEV_RAM
 		int fd;
 		printk(KERN_INFO "Trying to unpack rootfs image as initramfs...\n");
@@ -1071,6 +1071,9 @@ static noinline void __init kernel_init_freeable(void)
 
 	(void) sys_dup(0);
 	(void) sys_dup(0);
+
+	squashfs_root_mount();
+
 	/*
 	 * check if there is an early userspace init.  If yes, let it do all
 	 * the work
@@ -25,6 +25,8 @@
 #include <linux/slab.h>
 #include <linux/filter.h>
 #include <linux/compiler.h>
+#include <linux/sort.h>
+#include <linux/stringhash.h>
 
 #include <asm/sections.h>
 
@@ -192,13 +194,125 @@ static unsigned long kallsyms_sym_address(int idx)
 	return kallsyms_relative_base - 1 - kallsyms_offsets[idx];
 }
 
+#ifdef CONFIG_KALLSYMS_NAME_INDEX
+/*
+ * The kernel symbols sorted by the hash of their name, so that looking up
+ * a name is a binary search plus the expansion of the few symbols sharing
+ * its hash, rather than the expansion of every symbol in turn.  Symbols
+ * with the same hash stay in kallsyms order, so that the first of several
+ * symbols of the same name is still the one found.
+ */
+struct kallsyms_name_entry {
+	u32 hash;
+	u32 idx;
+};
+
+static struct kallsyms_name_entry *kallsyms_name_index;
+
+static u32 kallsyms_name_hash(const char *name)
+{
+	return full_name_hash(NULL, name, strlen(name));
+}
+
+static int kallsyms_name_cmp(const void *a, const void *b)
+{
+	const struct kallsyms_name_entry *ea = a, *eb = b;
+
+	if (ea->hash != eb->hash)
+		return ea->hash < eb->hash ? -1 : 1;
+	return ea->idx < eb->idx ? -1 : ea->idx > eb->idx;
+}
+
+static void kallsyms_name_swap(void *a, void *b, int size)
+{
+	swap(*(struct kallsyms_name_entry *)a, *(struct kallsyms_name_entry *)b);
+}
+
+static bool kallsyms_index_lookup(const char *name, unsigned long *addr)
+{
+	struct kallsyms_name_entry *index;
+	char namebuf[KSYM_NAME_LEN];
+	unsigned long low, high, mid;
+	u32 hash;
+
+	index = smp_load_acquire(&kallsyms_name_index);
+	if (!index)
+		return false;
+
+	/* Find the first entry with this hash */
+	hash = kallsyms_name_hash(name);
+	low = 0;
+	high = kallsyms_num_syms;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (index[mid].hash < hash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	*addr = 0;
+	for (; low < kallsyms_num_syms && index[low].hash == hash; low++) {
+		kallsyms_expand_symbol(get_symbol_offset(index[low].idx),
+				       namebuf, ARRAY_SIZE(namebuf));
+		if (strcmp(namebuf, name) == 0) {
+			*addr = kallsyms_sym_address(index[low].idx);
+			break;
+		}
+	}
+
+	return true;
+}
+
+static int __init kallsyms_name_index_init(void)
+{
+	struct kallsyms_name_entry *index;
+	char namebuf[KSYM_NAME_LEN];
+	unsigned long i;
+	unsigned int off;
+	size_t size;
+
+	if (!kallsyms_num_syms)
+		return 0;
+
+	size = kallsyms_num_syms * sizeof(*index);
+	index = kvmalloc(size, GFP_KERNEL);
+	if (!index) {
+		pr_warn("kallsyms: no memory for the name index\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
+		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
+		index[i].hash = kallsyms_name_hash(namebuf);
+		index[i].idx = i;
+	}
+	sort(index, kallsyms_num_syms, sizeof(*index), kallsyms_name_cmp,
+	     kallsyms_name_swap);
+
+	smp_store_release(&kallsyms_name_index, index);
+	pr_info("kallsyms: name index of %lu symbols, %zu KiB\n",
+		kallsyms_num_syms, size >> 10);
+	return 0;
+}
+core_initcall(kallsyms_name_index_init);
+#else
+static inline bool kallsyms_index_lookup(const char *name, unsigned long *addr)
+{
+	return false;
+}
+#endif /* CONFIG_KALLSYMS_NAME_INDEX */
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
 	char namebuf[KSYM_NAME_LEN];
-	unsigned long i;
+	unsigned long i, addr;
 	unsigned int off;
 
+	if (kallsyms_index_lookup(name, &addr))
+		return addr ? addr : module_kallsyms_lookup_name(name);
+
 	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
 		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
 
@@ -10,3 +10,14 @@
  */
 
 extern int mod_verify_sig(const void *mod, unsigned long *_modlen);
+
+#ifdef CONFIG_MODULE_DECOMPRESS
+extern int module_decompress(const void *buf, unsigned long size,
+			     void **data, unsigned long *len);
+#else
+static inline int module_decompress(const void *buf, unsigned long size,
+				    void **data, unsigned long *len)
+{
+	return -EOPNOTSUPP;
+}
+#endif
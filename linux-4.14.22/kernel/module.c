@@ -64,6 +64,8 @@
 #include <linux/bsearch.h>
 #include <linux/dynamic_debug.h>
 #include <linux/audit.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
 #include <uapi/linux/module.h>
 #include "module-internal.h"
 
@@ -429,6 +431,57 @@ static bool each_symbol_in_section(const struct symsearch *arr,
 	return false;
 }
 
+#ifdef CONFIG_UNUSED_SYMBOLS
+#define NR_SYMSEARCH	5
+#else
+#define NR_SYMSEARCH	3
+#endif
+
+static const struct symsearch kernel_symsearch[NR_SYMSEARCH] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
+static void module_symsearch(struct module *mod,
+			     struct symsearch arr[NR_SYMSEARCH])
+{
+	struct symsearch *s = arr;
+
+	*s++ = (struct symsearch){ mod->syms, mod->syms + mod->num_syms,
+				   mod->crcs, NOT_GPL_ONLY, false };
+	*s++ = (struct symsearch){ mod->gpl_syms,
+				   mod->gpl_syms + mod->num_gpl_syms,
+				   mod->gpl_crcs, GPL_ONLY, false };
+	*s++ = (struct symsearch){ mod->gpl_future_syms,
+				   mod->gpl_future_syms +
+				   mod->num_gpl_future_syms,
+				   mod->gpl_future_crcs, WILL_BE_GPL_ONLY,
+				   false };
+#ifdef CONFIG_UNUSED_SYMBOLS
+	*s++ = (struct symsearch){ mod->unused_syms,
+				   mod->unused_syms + mod->num_unused_syms,
+				   mod->unused_crcs, NOT_GPL_ONLY, true };
+	*s++ = (struct symsearch){ mod->unused_gpl_syms,
+				   mod->unused_gpl_syms +
+				   mod->num_unused_gpl_syms,
+				   mod->unused_gpl_crcs, GPL_ONLY, true };
+#endif
+}
+
 /* Returns true as soon as fn returns true, otherwise false. */
 bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 				    struct module *owner,
@@ -436,57 +489,21 @@ bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 			 void *data)
 {
 	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
-		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
-		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
-		  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
-		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
-		  GPL_ONLY, true },
-#endif
-	};
 
 	module_assert_mutex_or_preempt();
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_section(kernel_symsearch, NR_SYMSEARCH, NULL,
+				   fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
-		struct symsearch arr[] = {
-			{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
-			  NOT_GPL_ONLY, false },
-			{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
-			  mod->gpl_crcs,
-			  GPL_ONLY, false },
-			{ mod->gpl_future_syms,
-			  mod->gpl_future_syms + mod->num_gpl_future_syms,
-			  mod->gpl_future_crcs,
-			  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-			{ mod->unused_syms,
-			  mod->unused_syms + mod->num_unused_syms,
-			  mod->unused_crcs,
-			  NOT_GPL_ONLY, true },
-			{ mod->unused_gpl_syms,
-			  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
-			  mod->unused_gpl_crcs,
-			  GPL_ONLY, true },
-#endif
-		};
+		struct symsearch arr[NR_SYMSEARCH];
 
 		if (mod->state == MODULE_STATE_UNFORMED)
 			continue;
 
-		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
+		module_symsearch(mod, arr);
+		if (each_symbol_in_section(arr, NR_SYMSEARCH, mod, fn, data))
 			return true;
 	}
 	return false;
@@ -563,6 +580,171 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+#ifdef CONFIG_MODULE_SYMBOL_HASH
+/*
+ * All the exported symbols of the kernel and of the formed modules, hashed
+ * by name.  Entries are added and removed under module_mutex, and looked
+ * up under module_mutex or with preemption disabled, like the module list.
+ */
+#define KSYM_HASH_BITS	12
+
+struct ksym_section {
+	struct symsearch syms;
+	struct module *owner;
+};
+
+struct ksym_hash_entry {
+	struct hlist_node node;
+	const struct kernel_symbol *sym;
+	const struct ksym_section *sect;
+};
+
+struct ksym_table {
+	struct ksym_section sects[NR_SYMSEARCH];
+	unsigned int num;
+	struct ksym_hash_entry entries[];
+};
+
+static DEFINE_HASHTABLE(ksym_hash, KSYM_HASH_BITS);
+/* Set once the kernel's own symbols are in ksym_hash */
+static bool ksym_hash_ready;
+
+static u32 ksym_hash_name(const char *name)
+{
+	return full_name_hash(NULL, name, strlen(name));
+}
+
+static struct ksym_table *ksym_table_add(const struct symsearch *arr,
+					 struct module *owner)
+{
+	const struct kernel_symbol *sym;
+	struct ksym_hash_entry *e;
+	struct ksym_table *table;
+	unsigned int i, num = 0;
+
+	for (i = 0; i < NR_SYMSEARCH; i++)
+		num += arr[i].stop - arr[i].start;
+
+	table = kvmalloc(sizeof(*table) + num * sizeof(table->entries[0]),
+			 GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	table->num = num;
+	e = table->entries;
+	for (i = 0; i < NR_SYMSEARCH; i++) {
+		table->sects[i].syms = arr[i];
+		table->sects[i].owner = owner;
+		for (sym = arr[i].start; sym < arr[i].stop; sym++, e++) {
+			e->sym = sym;
+			e->sect = &table->sects[i];
+			hash_add_rcu(ksym_hash, &e->node, ksym_hash_name(sym->name));
+		}
+	}
+
+	return table;
+}
+
+/*
+ * Called with module_mutex held, before the module is made visible.  Its
+ * entries are in ksym_hash while it is still unformed, so lookups have to
+ * skip them until then, as each_symbol_section() does.
+ */
+static int module_ksym_hash(struct module *mod)
+{
+	struct symsearch arr[NR_SYMSEARCH];
+
+	module_symsearch(mod, arr);
+	mod->ksym_table = ksym_table_add(arr, mod);
+
+	return mod->ksym_table ? 0 : -ENOMEM;
+}
+
+/*
+ * Called with module_mutex held, when the module stops being visible.  The
+ * table is freed by module_ksym_free() after an RCU-sched grace period.
+ */
+static void module_ksym_unhash(struct module *mod)
+{
+	struct ksym_table *table = mod->ksym_table;
+	unsigned int i;
+
+	if (!table)
+		return;
+
+	for (i = 0; i < table->num; i++)
+		hash_del_rcu(&table->entries[i].node);
+}
+
+static void module_ksym_free(struct module *mod)
+{
+	kvfree(mod->ksym_table);
+	mod->ksym_table = NULL;
+}
+
+static bool find_symbol_hashed(struct find_symbol_arg *fsa)
+{
+	struct ksym_hash_entry *e;
+	const struct symsearch *syms;
+
+	hash_for_each_possible_rcu(ksym_hash, e, node,
+				   ksym_hash_name(fsa->name)) {
+		if (strcmp(e->sym->name, fsa->name))
+			continue;
+		if (e->sect->owner &&
+		    e->sect->owner->state == MODULE_STATE_UNFORMED)
+			continue;
+		syms = &e->sect->syms;
+		if (check_symbol(syms, e->sect->owner, e->sym - syms->start,
+				 fsa))
+			return true;
+	}
+
+	return false;
+}
+
+static int __init ksym_hash_init(void)
+{
+	mutex_lock(&module_mutex);
+	if (ksym_table_add(kernel_symsearch, NULL))
+		smp_store_release(&ksym_hash_ready, true);
+	else
+		pr_warn("no memory for the symbol hash, using a linear search\n");
+	mutex_unlock(&module_mutex);
+
+	return 0;
+}
+core_initcall(ksym_hash_init);
+
+static bool each_symbol_find(struct find_symbol_arg *fsa)
+{
+	module_assert_mutex_or_preempt();
+
+	if (smp_load_acquire(&ksym_hash_ready))
+		return find_symbol_hashed(fsa);
+
+	return each_symbol_section(find_symbol_in_section, fsa);
+}
+#else
+static inline int module_ksym_hash(struct module *mod)
+{
+	return 0;
+}
+
+static inline void module_ksym_unhash(struct module *mod)
+{
+}
+
+static inline void module_ksym_free(struct module *mod)
+{
+}
+
+static bool each_symbol_find(struct find_symbol_arg *fsa)
+{
+	return each_symbol_section(find_symbol_in_section, fsa);
+}
+#endif /* CONFIG_MODULE_SYMBOL_HASH */
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -577,7 +759,7 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	if (each_symbol_find(&fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1384,8 +1566,24 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 	struct module *owner;
 	const struct kernel_symbol *sym;
 	const s32 *crc;
+	bool gplok = !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE));
 	int err;
 
+	/*
+	 * Symbols exported by the kernel itself never go away and need no
+	 * module reference, so look them up without module_mutex: modules
+	 * loaded in parallel only serialise on symbols from other modules.
+	 */
+	preempt_disable();
+	sym = find_symbol(name, &owner, &crc, gplok, true);
+	preempt_enable();
+	if (sym && !owner) {
+		if (!check_version(info, name, mod, crc))
+			sym = ERR_PTR(-EINVAL);
+		strncpy(ownername, module_name(NULL), MODULE_NAME_LEN);
+		return sym;
+	}
+
 	/*
 	 * The module_mutex should not be a heavily contended lock;
 	 * if we get the occasional sleep here, we'll go an extra iteration
@@ -1393,8 +1591,8 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 	 */
 	sched_annotate_sleep();
 	mutex_lock(&module_mutex);
-	sym = find_symbol(name, &owner, &crc,
-			  !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE)), true);
+	/* Don't warn twice about a symbol the lookup above already found */
+	sym = find_symbol(name, &owner, &crc, gplok, !sym);
 	if (!sym)
 		goto unlock;
 
@@ -2132,6 +2330,7 @@ static void free_module(struct module *mod)
 	 * that noone uses it while it's being deconstructed. */
 	mutex_lock(&module_mutex);
 	mod->state = MODULE_STATE_UNFORMED;
+	module_ksym_unhash(mod);
 	mutex_unlock(&module_mutex);
 
 	/* Remove dynamic debug info */
@@ -2160,6 +2359,8 @@ static void free_module(struct module *mod)
 	synchronize_sched();
 	mutex_unlock(&module_mutex);
 
+	module_ksym_free(mod);
+
 	/* This may be empty, but that's OK */
 	disable_ro_nx(&mod->init_layout);
 	module_arch_freeing_init(mod);
@@ -3588,6 +3789,10 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (err < 0)
 		goto out;
 
+	err = module_ksym_hash(mod);
+	if (err < 0)
+		goto out;
+
 	/* This relies on module_mutex for list integrity. */
 	module_bug_finalize(info->hdr, info->sechdrs, mod);
 
@@ -3804,10 +4009,12 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	module_ksym_unhash(mod);
 	wake_up_all(&module_wq);
 	/* Wait for RCU-sched synchronizing before releasing mod->list. */
 	synchronize_sched();
 	mutex_unlock(&module_mutex);
+	module_ksym_free(mod);
  free_module:
 	/*
 	 * Ftrace needs to clean up what it initialized.
@@ -3858,13 +4065,29 @@ SYSCALL_DEFINE3(finit_module, int, fd, const char __user *, uargs, int, flags)
 	pr_debug("finit_module: fd=%d, uargs=%p, flags=%i\n", fd, uargs, flags);
 
 	if (flags & ~(MODULE_INIT_IGNORE_MODVERSIONS
-		      |MODULE_INIT_IGNORE_VERMAGIC))
+		      |MODULE_INIT_IGNORE_VERMAGIC
+		      |MODULE_INIT_COMPRESSED_FILE))
 		return -EINVAL;
 
 	err = kernel_read_file_from_fd(fd, &hdr, &size, INT_MAX,
 				       READING_MODULE);
 	if (err)
 		return err;
+
+	if (flags & MODULE_INIT_COMPRESSED_FILE) {
+		void *data;
+		unsigned long len;
+
+		err = module_decompress(hdr, size, &data, &len);
+		vfree(hdr);
+		if (err)
+			return err;
+		hdr = data;
+		size = len;
+
+		/* The signature is checked on the decompressed module */
+		flags &= ~MODULE_INIT_COMPRESSED_FILE;
+	}
 	info.hdr = hdr;
 	info.len = size;
 
@@ -0,0 +1,211 @@
+/* In-kernel decompression of modules loaded with finit_module()
+ *
+ * modules_install compresses modules with CONFIG_MODULE_COMPRESS.  With
+ * MODULE_INIT_COMPRESSED_FILE, finit_module() takes such a module as is
+ * and decompresses it here, so that userspace needn't decompress it into
+ * a buffer of its own only for the kernel to copy it again.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public Licence
+ * as published by the Free Software Foundation; either version
+ * 2 of the Licence, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sysfs.h>
+#include <linux/vmalloc.h>
+
+#ifdef CONFIG_MODULE_COMPRESS_GZIP
+#include <linux/zlib.h>
+#define MODULE_COMPRESSION	"gzip"
+#else
+#include <linux/xz.h>
+#define MODULE_COMPRESSION	"xz"
+#endif
+
+#include "module-internal.h"
+
+/* Output buffer, doubled whenever the decompressor fills it */
+struct module_dbuf {
+	void *data;
+	unsigned long size;
+	unsigned long len;
+};
+
+static int module_dbuf_grow(struct module_dbuf *buf)
+{
+	unsigned long size = buf->size * 2;
+	void *data;
+
+	if (size > INT_MAX)
+		return -EFBIG;
+
+	data = vmalloc(size);
+	if (!data)
+		return -ENOMEM;
+
+	memcpy(data, buf->data, buf->len);
+	vfree(buf->data);
+	buf->data = data;
+	buf->size = size;
+
+	return 0;
+}
+
+#ifdef CONFIG_MODULE_COMPRESS_GZIP
+/* gzip -n is used, so only the name field may follow the fixed header */
+static size_t module_gzip_header_len(const u8 *buf, size_t size)
+{
+	const u8 signature[] = { 0x1f, 0x8b, 0x08 };
+	size_t len = 10;
+
+	if (size < len || memcmp(buf, signature, sizeof(signature)))
+		return 0;
+
+	if (buf[3] & 0x08) {
+		do {
+			if (len == size)
+				return 0;
+		} while (buf[len++] != '\0');
+	}
+
+	return len;
+}
+
+static int module_decompress_buf(const void *in, size_t in_len,
+				 struct module_dbuf *out)
+{
+	struct z_stream_s s = { };
+	size_t header;
+	int rc, err;
+
+	header = module_gzip_header_len(in, in_len);
+	if (!header) {
+		pr_err("not a gzip compressed module\n");
+		return -EINVAL;
+	}
+
+	s.workspace = vmalloc(zlib_inflate_workspacesize());
+	if (!s.workspace)
+		return -ENOMEM;
+
+	s.next_in = in + header;
+	s.avail_in = in_len - header;
+
+	/* The header was skipped, inflate the raw deflate stream */
+	rc = zlib_inflateInit2(&s, -MAX_WBITS);
+	if (rc != Z_OK) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	do {
+		if (out->len == out->size) {
+			err = module_dbuf_grow(out);
+			if (err)
+				goto out_end;
+		}
+		s.next_out = out->data + out->len;
+		s.avail_out = out->size - out->len;
+
+		rc = zlib_inflate(&s, Z_NO_FLUSH);
+		out->len = out->size - s.avail_out;
+	} while (rc == Z_OK);
+
+	err = rc == Z_STREAM_END ? 0 : -EINVAL;
+out_end:
+	zlib_inflateEnd(&s);
+out:
+	vfree(s.workspace);
+	return err;
+}
+#else
+static int module_decompress_buf(const void *in, size_t in_len,
+				 struct module_dbuf *out)
+{
+	struct xz_buf b = {
+		.in = in,
+		.in_size = in_len,
+	};
+	struct xz_dec *xz;
+	enum xz_ret ret;
+	int err = 0;
+
+	xz = xz_dec_init(XZ_DYNALLOC, (u32)-1);
+	if (!xz)
+		return -ENOMEM;
+
+	do {
+		if (out->len == out->size) {
+			err = module_dbuf_grow(out);
+			if (err)
+				goto out;
+		}
+		b.out = out->data;
+		b.out_pos = out->len;
+		b.out_size = out->size;
+
+		ret = xz_dec_run(xz, &b);
+		out->len = b.out_pos;
+	} while (ret == XZ_OK);
+
+	if (ret == XZ_MEM_ERROR || ret == XZ_MEMLIMIT_ERROR)
+		err = -ENOMEM;
+	else if (ret != XZ_STREAM_END) {
+		pr_err("xz decompression failed: %d\n", ret);
+		err = -EINVAL;
+	}
+out:
+	xz_dec_end(xz);
+	return err;
+}
+#endif
+
+/*
+ * Decompress the module image @buf of @size bytes into a new vmalloc()ed
+ * buffer, returned in @data and @len.
+ */
+int module_decompress(const void *buf, unsigned long size, void **data,
+		      unsigned long *len)
+{
+	struct module_dbuf out = { };
+	int err;
+
+	/* Modules typically compress to a third of their size or more */
+	out.size = PAGE_ALIGN(min_t(unsigned long, size * 4, INT_MAX));
+	out.data = vmalloc(out.size);
+	if (!out.data)
+		return -ENOMEM;
+
+	err = module_decompress_buf(buf, size, &out);
+	if (err) {
+		vfree(out.data);
+		return err;
+	}
+
+	*data = out.data;
+	*len = out.len;
+	return 0;
+}
+
+static ssize_t compression_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", MODULE_COMPRESSION);
+}
+
+static struct kobj_attribute module_compression_attr = __ATTR_RO(compression);
+
+static int __init module_decompress_sysfs_init(void)
+{
+	int err;
+
+	err = sysfs_create_file(&module_kset->kobj,
+				&module_compression_attr.attr);
+	if (err)
+		pr_warn("Failed to create 'compression' attribute: %d\n", err);
+
+	return 0;
+}
+late_initcall(module_decompress_sysfs_init);
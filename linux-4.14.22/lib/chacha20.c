@@ -13,9 +13,13 @@
 #include <linux/export.h>
 #include <linux/bitops.h>
 #include <linux/cryptohash.h>
+#include <linux/preempt.h>
+#include <linux/rcupdate.h>
 #include <asm/unaligned.h>
 #include <crypto/chacha20.h>
 
+static chacha20_blocks_fn_t chacha20_blocks_arch __read_mostly;
+
 static inline u32 rotl32(u32 v, u8 n)
 {
 	return (v << n) | (v >> (sizeof(v) * 8 - n));
@@ -77,3 +81,35 @@ extern void chacha20_block(u32 *state, void *stream)
 	state[12]++;
 }
 EXPORT_SYMBOL(chacha20_block);
+
+/*
+ * Generate nblocks of ChaCha20 keystream into stream and advance the block
+ * counter.  An architecture may register a SIMD implementation; whatever it
+ * declines (e.g. because the FPU is unusable in this context) is done with
+ * the generic chacha20_block().
+ */
+void chacha20_blocks(u32 *state, u8 *stream, unsigned int nblocks)
+{
+	chacha20_blocks_fn_t fn;
+	unsigned int done = 0;
+
+	preempt_disable();
+	fn = READ_ONCE(chacha20_blocks_arch);
+	if (fn)
+		done = fn(state, stream, nblocks);
+	preempt_enable();
+
+	for (; done < nblocks; done++)
+		chacha20_block(state, stream + done * CHACHA20_BLOCK_SIZE);
+}
+EXPORT_SYMBOL(chacha20_blocks);
+
+void chacha20_register_blocks(chacha20_blocks_fn_t fn)
+{
+	WRITE_ONCE(chacha20_blocks_arch, fn);
+
+	/* Callers run the implementation with preemption disabled. */
+	if (!fn)
+		synchronize_sched();
+}
+EXPORT_SYMBOL_GPL(chacha20_register_blocks);
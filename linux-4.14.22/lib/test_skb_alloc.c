@@ -0,0 +1,204 @@
+/*
+ * Microbenchmark of skb head allocation
+ *
+ * Times allocating and freeing skb-sized objects one at a time against
+ * the slab bulk API, and skbs through alloc_skb()/kfree_skb() against the
+ * NAPI path (napi_alloc_skb()/napi_consume_skb()), whose per-CPU cache of
+ * skb heads is refilled and drained in bulk.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/sched.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+
+/* Objects allocated before freeing them all, like an RX ring refill */
+#define BATCH	64
+
+static int rounds = 10000;
+module_param(rounds, int, 0);
+MODULE_PARM_DESC(rounds, "Number of batches of 64 objects (default: 10000)");
+
+static int bulk = 16;
+module_param(bulk, int, 0);
+MODULE_PARM_DESC(bulk, "Objects per slab bulk call (default: 16)");
+
+static void *objs[BATCH];
+static struct sk_buff *skbs[BATCH];
+static struct napi_struct test_napi;
+
+static void __init report(const char *name, u64 nsecs)
+{
+	u64 ops = (u64)rounds * BATCH;
+
+	pr_info("%-24s %8llu ns total, %4llu ns per object\n", name,
+		nsecs, div64_u64(nsecs, ops));
+}
+
+static int __init bench_slab_single(struct kmem_cache *cache, u64 *nsecs)
+{
+	int i, r;
+	u64 start;
+
+	start = ktime_get_ns();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < BATCH; i++) {
+			objs[i] = kmem_cache_alloc(cache, GFP_KERNEL);
+			if (!objs[i]) {
+				while (i--)
+					kmem_cache_free(cache, objs[i]);
+				return -ENOMEM;
+			}
+		}
+		for (i = 0; i < BATCH; i++)
+			kmem_cache_free(cache, objs[i]);
+		cond_resched();
+	}
+	*nsecs = ktime_get_ns() - start;
+
+	return 0;
+}
+
+static int __init bench_slab_bulk(struct kmem_cache *cache, u64 *nsecs)
+{
+	int i, r, n;
+	u64 start;
+
+	start = ktime_get_ns();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < BATCH; i += n) {
+			n = kmem_cache_alloc_bulk(cache, GFP_KERNEL,
+						  min(bulk, BATCH - i),
+						  objs + i);
+			if (!n) {
+				kmem_cache_free_bulk(cache, i, objs);
+				return -ENOMEM;
+			}
+		}
+		kmem_cache_free_bulk(cache, BATCH, objs);
+		cond_resched();
+	}
+	*nsecs = ktime_get_ns() - start;
+
+	return 0;
+}
+
+static int __init bench_skb(u64 *nsecs)
+{
+	int i, r;
+	u64 start;
+
+	start = ktime_get_ns();
+	for (r = 0; r < rounds; r++) {
+		local_bh_disable();
+		for (i = 0; i < BATCH; i++) {
+			skbs[i] = alloc_skb(128, GFP_ATOMIC);
+			if (!skbs[i]) {
+				while (i--)
+					kfree_skb(skbs[i]);
+				local_bh_enable();
+				return -ENOMEM;
+			}
+		}
+		for (i = 0; i < BATCH; i++)
+			kfree_skb(skbs[i]);
+		local_bh_enable();
+		cond_resched();
+	}
+	*nsecs = ktime_get_ns() - start;
+
+	return 0;
+}
+
+static int __init bench_napi_skb(u64 *nsecs)
+{
+	int i, r;
+	u64 start;
+
+	start = ktime_get_ns();
+	for (r = 0; r < rounds; r++) {
+		/* The NAPI cache is only used with BHs disabled */
+		local_bh_disable();
+		for (i = 0; i < BATCH; i++) {
+			skbs[i] = napi_alloc_skb(&test_napi, 128);
+			if (!skbs[i]) {
+				while (i--)
+					napi_consume_skb(skbs[i], BATCH);
+				local_bh_enable();
+				return -ENOMEM;
+			}
+		}
+		for (i = 0; i < BATCH; i++)
+			napi_consume_skb(skbs[i], BATCH);
+		local_bh_enable();
+		cond_resched();
+	}
+	*nsecs = ktime_get_ns() - start;
+
+	return 0;
+}
+
+static int __init test_skb_alloc_init(void)
+{
+	struct kmem_cache *cache;
+	u64 nsecs;
+	int err;
+
+	if (rounds <= 0 || bulk <= 0)
+		return -EINVAL;
+
+	cache = kmem_cache_create("test_skb_alloc", sizeof(struct sk_buff),
+				  0, SLAB_HWCACHE_ALIGN, NULL);
+	if (!cache)
+		return -ENOMEM;
+
+	pr_info("%d rounds of %d objects, slab bulk size %d\n",
+		rounds, BATCH, bulk);
+
+	err = bench_slab_single(cache, &nsecs);
+	if (err)
+		goto out;
+	report("kmem_cache_alloc/free", nsecs);
+
+	err = bench_slab_bulk(cache, &nsecs);
+	if (err)
+		goto out;
+	report("kmem_cache_alloc/free_bulk", nsecs);
+
+	err = bench_skb(&nsecs);
+	if (err)
+		goto out;
+	report("alloc_skb/kfree_skb", nsecs);
+
+	err = bench_napi_skb(&nsecs);
+	if (err)
+		goto out;
+	report("napi_alloc/consume_skb", nsecs);
+
+out:
+	kmem_cache_destroy(cache);
+	if (err)
+		pr_err("allocation failed\n");
+
+	/* Nothing to keep loaded */
+	return err ? err : -EAGAIN;
+}
+
+static void __exit test_skb_alloc_exit(void)
+{
+}
+
+module_init(test_skb_alloc_init);
+module_exit(test_skb_alloc_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -257,6 +257,9 @@ static void force_shm_swapin_readahead(struct vm_area_struct *vma,
 			continue;
 		}
 		swap = radix_to_swp_entry(page);
+		/* compressed in memory, see mm/shmem_compress.c */
+		if (non_swap_entry(swap))
+			continue;
 		page = read_swap_cache_async(swap, GFP_HIGHUSER_MOVABLE,
 							NULL, 0, false);
 		if (page)
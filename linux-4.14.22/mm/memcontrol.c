@@ -4528,6 +4528,10 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		page = find_get_entry(mapping, pgoff);
 		if (radix_tree_exceptional_entry(page)) {
 			swp_entry_t swp = radix_to_swp_entry(page);
+
+			/* compressed in memory, see mm/shmem_compress.c */
+			if (non_swap_entry(swp))
+				return NULL;
 			if (do_memsw_account())
 				*entry = swp;
 			page = find_get_page(swap_address_space(swp),
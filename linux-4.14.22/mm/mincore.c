@@ -68,8 +68,13 @@ static unsigned char mincore_page(struct address_space *mapping, pgoff_t pgoff)
 		 */
 		if (radix_tree_exceptional_entry(page)) {
 			swp_entry_t swp = radix_to_swp_entry(page);
-			page = find_get_page(swap_address_space(swp),
-					     swp_offset(swp));
+
+			/* compressed in memory, see mm/shmem_compress.c */
+			if (non_swap_entry(swp))
+				page = NULL;
+			else
+				page = find_get_page(swap_address_space(swp),
+						     swp_offset(swp));
 		}
 	} else
 		page = find_get_page(mapping, pgoff);
@@ -290,6 +290,24 @@ int page_group_by_mobility_disabled __read_mostly;
 
 #ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
 
+/* Memory of each node initialised during early boot, the rest is deferred */
+static unsigned long deferred_init_min_pgcnt __meminitdata =
+	2UL << (30 - PAGE_SHIFT);
+
+/*
+ * deferred_init_size=size sets how much of each node's memory is
+ * initialised before the other CPUs are up.
+ */
+static int __init cmdline_parse_deferred_init_size(char *p)
+{
+	if (!p)
+		return -EINVAL;
+
+	deferred_init_min_pgcnt = memparse(p, &p) >> PAGE_SHIFT;
+	return 0;
+}
+early_param("deferred_init_size", cmdline_parse_deferred_init_size);
+
 /*
  * Determine how many pages need to be initialized durig early boot
  * (non-deferred initialization).
@@ -303,10 +321,11 @@ static inline void reset_deferred_meminit(pg_data_t *pgdat)
 	unsigned long reserved;
 
 	/*
-	 * Initialise at least 2G of a node but also take into account that
-	 * two large system hashes that can take up 1GB for 0.25TB/node.
+	 * Initialise at least 2G (or deferred_init_size=) of a node but also
+	 * take into account that two large system hashes that can take up
+	 * 1GB for 0.25TB/node.
 	 */
-	max_pgcnt = max(2UL << (30 - PAGE_SHIFT),
+	max_pgcnt = max(deferred_init_min_pgcnt,
 			(pgdat->node_spanned_pages >> 8));
 
 	/*
@@ -1263,7 +1282,9 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 	local_irq_restore(flags);
 }
 
-static void __init __free_pages_boot_core(struct page *page, unsigned int order)
+/* Free boot memory to the buddy allocator, the caller accounts it */
+static void __init __free_pages_boot_nocount(struct page *page,
+					     unsigned int order)
 {
 	unsigned int nr_pages = 1 << order;
 	struct page *p = page;
@@ -1278,11 +1299,16 @@ static void __init __free_pages_boot_core(struct page *page, unsigned int order)
 	__ClearPageReserved(p);
 	set_page_count(p, 0);
 
-	page_zone(page)->managed_pages += nr_pages;
 	set_page_refcounted(page);
 	__free_pages(page, order);
 }
 
+static void __init __free_pages_boot_core(struct page *page, unsigned int order)
+{
+	page_zone(page)->managed_pages += 1 << order;
+	__free_pages_boot_nocount(page, order);
+}
+
 #if defined(CONFIG_HAVE_ARCH_EARLY_PFN_TO_NID) || \
 	defined(CONFIG_HAVE_MEMBLOCK_NODE_MAP)
 
@@ -1429,14 +1455,14 @@ static void __init deferred_free_range(struct page *page,
 	if (nr_pages == pageblock_nr_pages &&
 	    (pfn & (pageblock_nr_pages - 1)) == 0) {
 		set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-		__free_pages_boot_core(page, pageblock_order);
+		__free_pages_boot_nocount(page, pageblock_order);
 		return;
 	}
 
 	for (i = 0; i < nr_pages; i++, page++, pfn++) {
 		if ((pfn & (pageblock_nr_pages - 1)) == 0)
 			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-		__free_pages_boot_core(page, 0);
+		__free_pages_boot_nocount(page, 0);
 	}
 }
 
@@ -1450,56 +1476,32 @@ static inline void __init pgdat_init_report_one_done(void)
 		complete(&pgdat_init_all_done_comp);
 }
 
-/* Initialise remaining memory on a node */
-static int __init deferred_init_memmap(void *data)
+/*
+ * Initialise the struct pages of [start_pfn, end_pfn) in a node's deferred
+ * zone and free them, returning how many were.  The caller accounts them
+ * in zone->managed_pages, so that threads working on parts of the same
+ * zone don't race on it.
+ */
+static unsigned long __init deferred_init_range(int nid, int zid,
+		struct zone *zone, unsigned long start_pfn,
+		unsigned long end_pfn)
 {
-	pg_data_t *pgdat = data;
-	int nid = pgdat->node_id;
 	struct mminit_pfnnid_cache nid_init_state = { };
-	unsigned long start = jiffies;
 	unsigned long nr_pages = 0;
 	unsigned long walk_start, walk_end;
-	int i, zid;
-	struct zone *zone;
-	unsigned long first_init_pfn = pgdat->first_deferred_pfn;
-	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-
-	if (first_init_pfn == ULONG_MAX) {
-		pgdat_init_report_one_done();
-		return 0;
-	}
-
-	/* Bind memory initialisation thread to a local node if possible */
-	if (!cpumask_empty(cpumask))
-		set_cpus_allowed_ptr(current, cpumask);
-
-	/* Sanity check boundaries */
-	BUG_ON(pgdat->first_deferred_pfn < pgdat->node_start_pfn);
-	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
-	pgdat->first_deferred_pfn = ULONG_MAX;
-
-	/* Only the highest zone is deferred so find it */
-	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
-		zone = pgdat->node_zones + zid;
-		if (first_init_pfn < zone_end_pfn(zone))
-			break;
-	}
+	int i;
 
 	for_each_mem_pfn_range(i, nid, &walk_start, &walk_end, NULL) {
-		unsigned long pfn, end_pfn;
+		unsigned long pfn, end;
 		struct page *page = NULL;
 		struct page *free_base_page = NULL;
 		unsigned long free_base_pfn = 0;
 		int nr_to_free = 0;
 
-		end_pfn = min(walk_end, zone_end_pfn(zone));
-		pfn = first_init_pfn;
-		if (pfn < walk_start)
-			pfn = walk_start;
-		if (pfn < zone->zone_start_pfn)
-			pfn = zone->zone_start_pfn;
+		end = min(walk_end, end_pfn);
+		pfn = max(walk_start, start_pfn);
 
-		for (; pfn < end_pfn; pfn++) {
+		for (; pfn < end; pfn++) {
 			if (!pfn_valid_within(pfn))
 				goto free_range;
 
@@ -1559,16 +1561,143 @@ free_range:
 		/* Free the last block of pages to allocator */
 		nr_pages += nr_to_free;
 		deferred_free_range(free_base_page, free_base_pfn, nr_to_free);
+	}
+
+	spin_lock(&managed_page_count_lock);
+	zone->managed_pages += nr_pages;
+	spin_unlock(&managed_page_count_lock);
+
+	return nr_pages;
+}
+
+/* A part of a node's deferred memory, initialised by its own thread */
+struct deferred_init_chunk {
+	pg_data_t *pgdat;
+	struct zone *zone;
+	int zid;
+	unsigned long start_pfn;
+	unsigned long end_pfn;
+	unsigned long nr_pages;
+	struct completion done;
+};
+
+static int __init deferred_init_chunk(void *data)
+{
+	struct deferred_init_chunk *chunk = data;
+	const struct cpumask *cpumask = cpumask_of_node(chunk->pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	chunk->nr_pages = deferred_init_range(chunk->pgdat->node_id, chunk->zid,
+			chunk->zone, chunk->start_pfn, chunk->end_pfn);
+	complete(&chunk->done);
+	return 0;
+}
+
+/*
+ * Number of threads initialising each node's deferred memory, 0 for one
+ * per CPU of the node.
+ */
+static unsigned int deferred_init_threads __initdata;
+
+static int __init cmdline_parse_deferred_init_threads(char *p)
+{
+	return kstrtouint(p, 0, &deferred_init_threads);
+}
+early_param("deferred_init_threads", cmdline_parse_deferred_init_threads);
+
+/* Total deferred pages initialised and the time it took, for the report */
+static atomic_long_t pgdat_init_nr_pages __initdata;
+
+/* Initialise remaining memory on a node */
+static int __init deferred_init_memmap(void *data)
+{
+	pg_data_t *pgdat = data;
+	int nid = pgdat->node_id;
+	unsigned long start = jiffies;
+	unsigned long nr_pages = 0;
+	unsigned long pfn, end_pfn, per_thread;
+	struct deferred_init_chunk *chunks;
+	unsigned int nr_threads, t;
+	int zid;
+	struct zone *zone;
+	unsigned long first_init_pfn = pgdat->first_deferred_pfn;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
 
-		first_init_pfn = max(end_pfn, first_init_pfn);
+	if (first_init_pfn == ULONG_MAX) {
+		pgdat_init_report_one_done();
+		return 0;
 	}
 
+	/* Bind memory initialisation thread to a local node if possible */
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	/* Sanity check boundaries */
+	BUG_ON(pgdat->first_deferred_pfn < pgdat->node_start_pfn);
+	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
+	pgdat->first_deferred_pfn = ULONG_MAX;
+
+	/* Only the highest zone is deferred so find it */
+	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+		zone = pgdat->node_zones + zid;
+		if (first_init_pfn < zone_end_pfn(zone))
+			break;
+	}
+
+	pfn = max(first_init_pfn, zone->zone_start_pfn);
+	end_pfn = zone_end_pfn(zone);
+
+	/*
+	 * Split the zone between threads on section boundaries, so that
+	 * none of them shares a pageblock with another.
+	 */
+	nr_threads = deferred_init_threads;
+	if (!nr_threads)
+		nr_threads = max(cpumask_weight(cpumask), 1U);
+	per_thread = ALIGN(DIV_ROUND_UP(end_pfn - pfn, nr_threads),
+			   PAGES_PER_SECTION);
+	nr_threads = DIV_ROUND_UP(end_pfn - pfn, per_thread);
+
+	chunks = kcalloc(nr_threads, sizeof(*chunks), GFP_KERNEL);
+	if (!chunks) {
+		nr_threads = 1;
+		nr_pages = deferred_init_range(nid, zid, zone, pfn, end_pfn);
+		goto done;
+	}
+
+	for (t = 0; t < nr_threads; t++, pfn += per_thread) {
+		struct deferred_init_chunk *chunk = &chunks[t];
+
+		chunk->pgdat = pgdat;
+		chunk->zone = zone;
+		chunk->zid = zid;
+		chunk->start_pfn = pfn;
+		chunk->end_pfn = min(pfn + per_thread, end_pfn);
+		init_completion(&chunk->done);
+
+		/* This thread takes the last chunk itself */
+		if (t == nr_threads - 1 ||
+		    IS_ERR(kthread_run(deferred_init_chunk, chunk,
+				       "pgdatinit%d.%u", nid, t)))
+			deferred_init_chunk(chunk);
+	}
+
+	for (t = 0; t < nr_threads; t++) {
+		wait_for_completion(&chunks[t].done);
+		nr_pages += chunks[t].nr_pages;
+	}
+	kfree(chunks);
+
+done:
 	/* Sanity check that the next zone really is unpopulated */
 	WARN_ON(++zid < MAX_NR_ZONES && populated_zone(++zone));
 
-	pr_info("node %d initialised, %lu pages in %ums\n", nid, nr_pages,
-					jiffies_to_msecs(jiffies - start));
+	pr_info("node %d initialised, %lu pages in %ums using %u threads\n",
+		nid, nr_pages, jiffies_to_msecs(jiffies - start), nr_threads);
 
+	atomic_long_add(nr_pages, &pgdat_init_nr_pages);
 	pgdat_init_report_one_done();
 	return 0;
 }
@@ -1579,6 +1708,7 @@ void __init page_alloc_init_late(void)
 	struct zone *zone;
 
 #ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	unsigned long start = jiffies;
 	int nid;
 
 	/* There will be num_node_state(N_MEMORY) threads */
@@ -1590,6 +1720,10 @@ void __init page_alloc_init_late(void)
 	/* Block until all are initialised */
 	wait_for_completion(&pgdat_init_all_done_comp);
 
+	pr_info("deferred memmap init: %lu pages in %ums\n",
+		atomic_long_read(&pgdat_init_nr_pages),
+		jiffies_to_msecs(jiffies - start));
+
 	/* Reinit limits that are based on free pages after the kernel is up */
 	files_maxfiles_init();
 #endif
@@ -658,7 +658,10 @@ static int shmem_free_swap(struct address_space *mapping,
 	spin_unlock_irq(&mapping->tree_lock);
 	if (old != radswap)
 		return -ENOENT;
-	free_swap_and_cache(radix_to_swp_entry(radswap));
+	if (is_shmem_compress_entry(radix_to_swp_entry(radswap)))
+		shmem_compress_free(radix_to_swp_entry(radswap));
+	else
+		free_swap_and_cache(radix_to_swp_entry(radswap));
 	return 0;
 }
 
@@ -1262,7 +1265,7 @@ static int shmem_writepage(struct page *page, struct writeback_control *wbc)
 	info = SHMEM_I(inode);
 	if (info->flags & VM_LOCKED)
 		goto redirty;
-	if (!total_swap_pages)
+	if (!total_swap_pages && !shmem_compress_enabled())
 		goto redirty;
 
 	/*
@@ -1309,6 +1312,27 @@ static int shmem_writepage(struct page *page, struct writeback_control *wbc)
 		SetPageUptodate(page);
 	}
 
+	/*
+	 * Try to keep the page compressed in memory before writing it to
+	 * swap: the page cache entry is replaced as for swap, but there is
+	 * no swap cache page and no I/O, so the page can be freed at once.
+	 */
+	if (shmem_compress_enabled()) {
+		swap = shmem_compress_store(page);
+		if (swap.val) {
+			spin_lock_irq(&info->lock);
+			shmem_recalc_inode(inode);
+			info->swapped++;
+			spin_unlock_irq(&info->lock);
+
+			shmem_delete_from_page_cache(page,
+						     swp_to_radix_entry(swap));
+			BUG_ON(page_mapped(page));
+			unlock_page(page);
+			return 0;
+		}
+	}
+
 	swap = get_swap_page(page);
 	if (!swap.val)
 		goto redirty;
@@ -1580,6 +1604,64 @@ static int shmem_replace_page(struct page **pagep, gfp_t gfp,
 	return error;
 }
 
+/*
+ * Bring back a page compressed by shmem_writepage().  The new page replaces
+ * the entry in the page cache before it is filled, under its page lock:
+ * from then on truncation can't find the compressed copy to free it, and
+ * anyone looking the page up waits for it to be uptodate.
+ */
+static int shmem_swapin_compressed(struct inode *inode, pgoff_t index,
+		swp_entry_t swap, struct page **pagep, gfp_t gfp,
+		struct mm_struct *charge_mm)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	void *radswap = swp_to_radix_entry(swap);
+	struct mem_cgroup *memcg;
+	struct page *page;
+	int error;
+
+	page = shmem_alloc_page(gfp, info, index);
+	if (!page)
+		return -ENOMEM;
+	__SetPageLocked(page);
+	__SetPageSwapBacked(page);
+
+	error = mem_cgroup_try_charge(page, charge_mm, gfp, &memcg, false);
+	if (error)
+		goto out_put;
+	error = shmem_add_to_page_cache(page, mapping, index, radswap);
+	if (error) {
+		mem_cgroup_cancel_charge(page, memcg, false);
+		goto out_put;
+	}
+	mem_cgroup_commit_charge(page, memcg, false, false);
+	lru_cache_add_anon(page);
+
+	error = shmem_compress_load(swap, page);
+	if (error) {
+		/* Leave the compressed copy where it was */
+		shmem_delete_from_page_cache(page, radswap);
+		goto out_put;
+	}
+	SetPageUptodate(page);
+
+	spin_lock_irq(&info->lock);
+	info->swapped--;
+	shmem_recalc_inode(inode);
+	spin_unlock_irq(&info->lock);
+
+	set_page_dirty(page);
+	shmem_compress_free(swap);
+	*pagep = page;
+	return 0;
+
+out_put:
+	unlock_page(page);
+	put_page(page);
+	return error;
+}
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -1648,7 +1730,16 @@ repeat:
 	sbinfo = SHMEM_SB(inode->i_sb);
 	charge_mm = vma ? vma->vm_mm : current->mm;
 
-	if (swap.val) {
+	if (swap.val && is_shmem_compress_entry(swap)) {
+		/* Compressed in memory: decompress it right here */
+		error = shmem_swapin_compressed(inode, index, swap, &page,
+						gfp, charge_mm);
+		if (error)
+			goto failed;
+
+		if (sgp == SGP_WRITE)
+			mark_page_accessed(page);
+	} else if (swap.val) {
 		/* Look it up and read it in.. */
 		page = lookup_swap_cache(swap, NULL, 0);
 		if (!page) {
@@ -0,0 +1,385 @@
+/*
+ * shmem_compress.c - compressed in-memory storage for tmpfs pages
+ *
+ * When memory is short, reclaim hands cold tmpfs pages to shmem_writepage(),
+ * which normally writes them to swap.  With shmem compression enabled it
+ * first tries to compress the page into a zsmalloc pool instead, and
+ * leaves an entry of the reserved SWP_SHMEM_COMPRESS swap type in the
+ * file's page cache in place of the page.  The next access to the page
+ * finds that entry and decompresses the page back, without any I/O.
+ *
+ * This works without any swap device configured, so a system that keeps
+ * its root filesystem in tmpfs can hold a few times more data in it than
+ * it has RAM for.  If a page does not compress well enough, or the pool
+ * is full, shmem_writepage() falls back to swap as before, if there is
+ * any.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/module.h>
+#include <linux/cpu.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/idr.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/shmem_fs.h>
+#include <linux/crypto.h>
+#include <linux/zsmalloc.h>
+
+/*********************************
+* statistics
+**********************************/
+/* The number of compressed pages currently stored */
+static atomic_t shmem_compress_stored_pages = ATOMIC_INIT(0);
+/* Total bytes used by the compressed pool */
+static u64 shmem_compress_pool_total_size;
+
+/*
+ * The statistics below are not protected from concurrent access, they
+ * only give an idea of how often each event happens.
+ */
+
+/* Pages compressed and stored */
+static u64 shmem_compress_stores;
+/* Pages decompressed on access */
+static u64 shmem_compress_loads;
+/* Store failed because the pool reached max_pool_percent */
+static u64 shmem_compress_pool_limit_hit;
+/* Page did not compress to less than PAGE_SIZE * 3 / 4 */
+static u64 shmem_compress_reject_compress_poor;
+/* Store failed because the pool or the index could not get memory */
+static u64 shmem_compress_reject_alloc_fail;
+
+/*********************************
+* tunables
+**********************************/
+
+/* Enable/disable compression of tmpfs pages (disabled by default) */
+static bool shmem_compress_enable;
+module_param_named(enabled, shmem_compress_enable, bool, 0644);
+
+/* Crypto compressor to use, can only be set on the command line */
+#define SHMEM_COMPRESS_COMPRESSOR_DEFAULT "lzo"
+static char *shmem_compress_compressor = SHMEM_COMPRESS_COMPRESSOR_DEFAULT;
+module_param_named(compressor, shmem_compress_compressor, charp, 0444);
+
+/* The maximum percentage of memory that the compressed pool can occupy */
+static unsigned int shmem_compress_max_pool_percent = 50;
+module_param_named(max_pool_percent, shmem_compress_max_pool_percent,
+		   uint, 0644);
+
+/*********************************
+* data structures
+**********************************/
+
+/*
+ * Each compressed page is a zsmalloc object, starting with the length of
+ * the compressed data that follows it.  The handle of the object is kept
+ * in an idr, and the id is the offset of the swap entry left in the page
+ * cache.
+ */
+struct shmem_compress_header {
+	unsigned int length;
+};
+
+static struct zs_pool *shmem_compress_pool;
+static DEFINE_IDR(shmem_compress_idr);
+static DEFINE_SPINLOCK(shmem_compress_idr_lock);
+static unsigned long shmem_compress_max_id;
+static bool shmem_compress_initialized;
+
+static DEFINE_PER_CPU(struct crypto_comp *, shmem_compress_tfm);
+static DEFINE_PER_CPU(u8 *, shmem_compress_dstmem);
+
+/*********************************
+* helpers
+**********************************/
+static void shmem_compress_update_total_size(void)
+{
+	shmem_compress_pool_total_size =
+		zs_get_total_pages(shmem_compress_pool) << PAGE_SHIFT;
+}
+
+static bool shmem_compress_is_full(void)
+{
+	return totalram_pages * shmem_compress_max_pool_percent / 100 <
+		DIV_ROUND_UP(shmem_compress_pool_total_size, PAGE_SIZE);
+}
+
+static unsigned long shmem_compress_lookup(swp_entry_t entry)
+{
+	unsigned long handle;
+
+	rcu_read_lock();
+	handle = (unsigned long)idr_find(&shmem_compress_idr,
+					 swp_offset(entry));
+	rcu_read_unlock();
+	return handle;
+}
+
+/*********************************
+* interface to shmem
+**********************************/
+
+bool shmem_compress_enabled(void)
+{
+	return shmem_compress_initialized && shmem_compress_enable;
+}
+
+/**
+ * shmem_compress_store - compress a tmpfs page into the pool
+ * @page: locked page, being written out by reclaim
+ *
+ * Returns the entry to put in the page cache in place of @page, or an
+ * entry with a zero val if the page was not stored.
+ */
+swp_entry_t shmem_compress_store(struct page *page)
+{
+	struct shmem_compress_header *zhdr;
+	swp_entry_t entry = { .val = 0 };
+	struct crypto_comp *tfm;
+	unsigned int dlen = PAGE_SIZE * 2;
+	unsigned long handle;
+	gfp_t gfp;
+	u8 *src, *dst, *buf;
+	int ret, id;
+
+	if (shmem_compress_is_full()) {
+		shmem_compress_pool_limit_hit++;
+		return entry;
+	}
+
+	/* compress */
+	dst = get_cpu_var(shmem_compress_dstmem);
+	tfm = *this_cpu_ptr(&shmem_compress_tfm);
+	src = kmap_atomic(page);
+	ret = crypto_comp_compress(tfm, src, PAGE_SIZE, dst, &dlen);
+	kunmap_atomic(src);
+	if (ret || dlen > PAGE_SIZE / 4 * 3) {
+		shmem_compress_reject_compress_poor++;
+		goto put_dstmem;
+	}
+
+	/* store, without entering direct reclaim from reclaim */
+	gfp = __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM;
+	handle = zs_malloc(shmem_compress_pool, sizeof(*zhdr) + dlen, gfp);
+	if (!handle) {
+		shmem_compress_reject_alloc_fail++;
+		goto put_dstmem;
+	}
+	zhdr = zs_map_object(shmem_compress_pool, handle, ZS_MM_WO);
+	zhdr->length = dlen;
+	buf = (u8 *)(zhdr + 1);
+	memcpy(buf, dst, dlen);
+	zs_unmap_object(shmem_compress_pool, handle);
+	put_cpu_var(shmem_compress_dstmem);
+
+	spin_lock(&shmem_compress_idr_lock);
+	id = idr_alloc(&shmem_compress_idr, (void *)handle, 1,
+		       shmem_compress_max_id, GFP_NOWAIT | __GFP_NOWARN);
+	spin_unlock(&shmem_compress_idr_lock);
+	if (id < 0) {
+		shmem_compress_reject_alloc_fail++;
+		zs_free(shmem_compress_pool, handle);
+		return entry;
+	}
+
+	atomic_inc(&shmem_compress_stored_pages);
+	shmem_compress_stores++;
+	shmem_compress_update_total_size();
+	return swp_entry(SWP_SHMEM_COMPRESS, id);
+
+put_dstmem:
+	put_cpu_var(shmem_compress_dstmem);
+	return entry;
+}
+
+/**
+ * shmem_compress_load - decompress a page stored by shmem_compress_store()
+ * @entry: entry returned by shmem_compress_store()
+ * @page: locked page to fill
+ *
+ * The compressed copy is kept: the caller frees it with
+ * shmem_compress_free() once it has replaced @entry by @page.
+ */
+int shmem_compress_load(swp_entry_t entry, struct page *page)
+{
+	struct shmem_compress_header *zhdr;
+	struct crypto_comp *tfm;
+	unsigned int dlen = PAGE_SIZE;
+	unsigned long handle;
+	u8 *src, *dst;
+	int ret;
+
+	handle = shmem_compress_lookup(entry);
+	if (WARN_ON_ONCE(!handle))
+		return -EIO;
+
+	zhdr = zs_map_object(shmem_compress_pool, handle, ZS_MM_RO);
+	src = (u8 *)(zhdr + 1);
+	dst = kmap_atomic(page);
+	tfm = *get_cpu_ptr(&shmem_compress_tfm);
+	ret = crypto_comp_decompress(tfm, src, zhdr->length, dst, &dlen);
+	put_cpu_ptr(&shmem_compress_tfm);
+	kunmap_atomic(dst);
+	zs_unmap_object(shmem_compress_pool, handle);
+
+	if (ret || dlen != PAGE_SIZE) {
+		pr_err("failed to decompress page (entry 0x%lx)\n",
+		       swp_offset(entry));
+		return -EIO;
+	}
+
+	shmem_compress_loads++;
+	return 0;
+}
+
+/**
+ * shmem_compress_free - free a page stored by shmem_compress_store()
+ * @entry: entry returned by shmem_compress_store()
+ *
+ * The caller must have taken @entry out of the page cache, so that
+ * nobody else can find it.
+ */
+void shmem_compress_free(swp_entry_t entry)
+{
+	unsigned long handle;
+
+	spin_lock(&shmem_compress_idr_lock);
+	handle = (unsigned long)idr_remove(&shmem_compress_idr,
+					   swp_offset(entry));
+	spin_unlock(&shmem_compress_idr_lock);
+	if (WARN_ON_ONCE(!handle))
+		return;
+
+	zs_free(shmem_compress_pool, handle);
+	atomic_dec(&shmem_compress_stored_pages);
+	shmem_compress_update_total_size();
+}
+
+/*********************************
+* debugfs functions
+**********************************/
+#ifdef CONFIG_DEBUG_FS
+#include <linux/debugfs.h>
+
+static struct dentry *shmem_compress_debugfs_root;
+
+static int __init shmem_compress_debugfs_init(void)
+{
+	if (!debugfs_initialized())
+		return -ENODEV;
+
+	shmem_compress_debugfs_root = debugfs_create_dir("shmem_compress",
+							 NULL);
+	if (!shmem_compress_debugfs_root)
+		return -ENOMEM;
+
+	debugfs_create_u64("stores", S_IRUGO,
+			shmem_compress_debugfs_root, &shmem_compress_stores);
+	debugfs_create_u64("loads", S_IRUGO,
+			shmem_compress_debugfs_root, &shmem_compress_loads);
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			shmem_compress_debugfs_root,
+			&shmem_compress_pool_limit_hit);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			shmem_compress_debugfs_root,
+			&shmem_compress_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			shmem_compress_debugfs_root,
+			&shmem_compress_reject_alloc_fail);
+	debugfs_create_u64("pool_total_size", S_IRUGO,
+			shmem_compress_debugfs_root,
+			&shmem_compress_pool_total_size);
+	debugfs_create_atomic_t("stored_pages", S_IRUGO,
+			shmem_compress_debugfs_root,
+			&shmem_compress_stored_pages);
+
+	return 0;
+}
+#else
+static int __init shmem_compress_debugfs_init(void)
+{
+	return 0;
+}
+#endif
+
+/*********************************
+* module init
+**********************************/
+static int __init shmem_compress_init(void)
+{
+	int cpu;
+
+	if (!crypto_has_comp(shmem_compress_compressor, 0, 0)) {
+		pr_err("compressor %s not available\n",
+		       shmem_compress_compressor);
+		return -ENODEV;
+	}
+
+	/*
+	 * Set up every possible CPU now rather than from CPU hotplug
+	 * callbacks: this costs one tfm and two pages per CPU.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm;
+		u8 *dst;
+
+		tfm = crypto_alloc_comp(shmem_compress_compressor, 0, 0);
+		if (IS_ERR(tfm)) {
+			pr_err("could not alloc crypto comp %s : %ld\n",
+			       shmem_compress_compressor, PTR_ERR(tfm));
+			goto fail;
+		}
+		per_cpu(shmem_compress_tfm, cpu) = tfm;
+
+		dst = kmalloc_node(PAGE_SIZE * 2, GFP_KERNEL,
+				   cpu_to_node(cpu));
+		if (!dst)
+			goto fail;
+		per_cpu(shmem_compress_dstmem, cpu) = dst;
+	}
+
+	shmem_compress_pool = zs_create_pool("shmem_compress");
+	if (!shmem_compress_pool)
+		goto fail;
+
+	/* The id must fit in the offset of a swap entry */
+	shmem_compress_max_id = min_t(unsigned long, INT_MAX,
+			swp_offset(swp_entry(0, ~0UL)));
+
+	if (shmem_compress_debugfs_init())
+		pr_warn("debugfs initialization failed\n");
+
+	pr_info("using %s compressor\n", shmem_compress_compressor);
+	shmem_compress_initialized = true;
+	return 0;
+
+fail:
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = per_cpu(shmem_compress_tfm, cpu);
+
+		if (!IS_ERR_OR_NULL(tfm))
+			crypto_free_comp(tfm);
+		kfree(per_cpu(shmem_compress_dstmem, cpu));
+		per_cpu(shmem_compress_tfm, cpu) = NULL;
+		per_cpu(shmem_compress_dstmem, cpu) = NULL;
+	}
+	pr_err("initialization failed\n");
+	return -ENOMEM;
+}
+/* must be late so crypto has time to come up */
+late_initcall(shmem_compress_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed in-memory storage for tmpfs pages");
@@ -54,6 +54,7 @@
 #include <asm/div64.h>
 
 #include <linux/swapops.h>
+#include <linux/shmem_fs.h>
 #include <linux/balloon_compaction.h>
 
 #include "internal.h"
@@ -1308,7 +1309,15 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 			count_vm_event(PGLAZYFREED);
 			count_memcg_page_event(page, PGLAZYFREED);
-		} else if (!mapping || !__remove_mapping(mapping, page, true))
+		} else if (!mapping) {
+			/*
+			 * shmem_writepage() takes a page it compressed out of
+			 * the page cache itself: free it unless someone else
+			 * still holds a reference.
+			 */
+			if (!page_ref_freeze(page, 1))
+				goto keep_locked;
+		} else if (!__remove_mapping(mapping, page, true))
 			goto keep_locked;
 		/*
 		 * At this point, we have no other references and there is
@@ -2113,9 +2122,9 @@ static bool inactive_list_is_low(struct lruvec *lruvec, bool file,
 
 	/*
 	 * If we don't have swap space, anonymous page deactivation
-	 * is pointless.
+	 * is pointless, unless tmpfs pages can be compressed instead.
 	 */
-	if (!file && !total_swap_pages)
+	if (!file && !total_swap_pages && !shmem_compress_enabled())
 		return false;
 
 	inactive = lruvec_lru_size(lruvec, inactive_lru, sc->reclaim_idx);
@@ -2195,8 +2204,12 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	unsigned long ap, fp;
 	enum lru_list lru;
 
-	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+	/*
+	 * If we have no swap space, do not bother scanning anon pages,
+	 * unless the tmpfs pages among them can be compressed instead.
+	 */
+	if (!sc->may_swap || (mem_cgroup_get_nr_swap_pages(memcg) <= 0 &&
+			      !shmem_compress_enabled())) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
@@ -3163,7 +3176,7 @@ static void age_active_anon(struct pglist_data *pgdat,
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	if (!total_swap_pages && !shmem_compress_enabled())
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
@@ -276,6 +276,26 @@ void zpool_free(struct zpool *zpool, unsigned long handle)
 	zpool->driver->free(zpool->pool, handle);
 }
 
+/**
+ * zpool_compact() - Compact the pool
+ * @pool	The zpool to compact.
+ *
+ * This attempts to shrink the actual memory size of the pool
+ * by moving allocations together to free the pages they leave
+ * empty, without evicting anything.  Implementations that can't
+ * move their allocations don't provide this, in which case
+ * nothing is done.
+ *
+ * Returns: The number of pages freed.
+ */
+unsigned long zpool_compact(struct zpool *zpool)
+{
+	if (!zpool->driver->compact)
+		return 0;
+
+	return zpool->driver->compact(zpool->pool);
+}
+
 /**
  * zpool_shrink() - Shrink the pool size
  * @pool	The zpool to shrink.
@@ -412,6 +412,17 @@ static int zs_zpool_shrink(void *pool, unsigned int pages,
 	return -EINVAL;
 }
 
+static unsigned long zs_zpool_compact(void *pool)
+{
+	struct zs_pool_stats stats;
+	unsigned long compacted;
+
+	zs_pool_stats(pool, &stats);
+	compacted = stats.pages_compacted;
+
+	return zs_compact(pool) - compacted;
+}
+
 static void *zs_zpool_map(void *pool, unsigned long handle,
 			enum zpool_mapmode mm)
 {
@@ -450,6 +461,7 @@ static struct zpool_driver zs_zpool_driver = {
 	.malloc =	zs_zpool_malloc,
 	.free =		zs_zpool_free,
 	.shrink =	zs_zpool_shrink,
+	.compact =	zs_zpool_compact,
 	.map =		zs_zpool_map,
 	.unmap =	zs_zpool_unmap,
 	.total_size =	zs_zpool_total_size,
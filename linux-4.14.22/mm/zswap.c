@@ -36,6 +36,8 @@
 #include <linux/mempool.h>
 #include <linux/zpool.h>
 
+#include <linux/seq_file.h>
+
 #include <linux/mm_types.h>
 #include <linux/page-flags.h>
 #include <linux/swapops.h>
@@ -61,6 +63,8 @@ static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
 static u64 zswap_pool_limit_hit;
 /* Pages written back when pool limit was reached */
 static u64 zswap_written_back_pages;
+/* Pages freed by compacting the pool when its limit was reached */
+static u64 zswap_compacted_pages;
 /* Store failed due to a reclaim failure after pool limit was reached */
 static u64 zswap_reject_reclaim_fail;
 /* Compressed page was too big for the allocator to (optimally) store */
@@ -120,6 +124,12 @@ module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
 * data structures
 **********************************/
 
+/*
+ * lru - the pool's entries, least recently stored last, used to write
+ *       entries back when the zpool can't evict them itself
+ * stored_size - the bytes of compressed data stored in the pool, which
+ *       against the zpool's total size tells how fragmented it is
+ */
 struct zswap_pool {
 	struct zpool *zpool;
 	struct crypto_comp * __percpu *tfm;
@@ -128,6 +138,12 @@ struct zswap_pool {
 	struct work_struct work;
 	struct hlist_node node;
 	char tfm_name[CRYPTO_MAX_ALG_NAME];
+	struct list_head lru;
+	spinlock_t lru_lock;
+	atomic64_t stored_size;
+	atomic_t stored_pages;
+	unsigned long compact_after;	/* jiffies, see zswap_compact() */
+	atomic_t compacting;
 };
 
 /*
@@ -138,6 +154,8 @@ struct zswap_pool {
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
  * offset - the swap offset for the entry.  Index into the red-black tree.
+ * type - the swap type for the entry, for finding its tree from the lru
+ * lru - links the entry into its pool's lru, protected by the pool lru_lock
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
@@ -152,6 +170,8 @@ struct zswap_pool {
 struct zswap_entry {
 	struct rb_node rbnode;
 	pgoff_t offset;
+	unsigned int type;
+	struct list_head lru;
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
@@ -251,6 +271,7 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 		return NULL;
 	entry->refcount = 1;
 	RB_CLEAR_NODE(&entry->rbnode);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
@@ -320,6 +341,15 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
  */
 static void zswap_free_entry(struct zswap_entry *entry)
 {
+	struct zswap_pool *pool = entry->pool;
+
+	spin_lock(&pool->lru_lock);
+	list_del(&entry->lru);
+	spin_unlock(&pool->lru_lock);
+	atomic64_sub(entry->length + sizeof(struct zswap_header),
+		     &pool->stored_size);
+	atomic_dec(&pool->stored_pages);
+
 	zpool_free(entry->pool->zpool, entry->handle);
 	zswap_pool_put(entry->pool);
 	zswap_entry_cache_free(entry);
@@ -545,6 +575,9 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	 */
 	kref_init(&pool->kref);
 	INIT_LIST_HEAD(&pool->list);
+	INIT_LIST_HEAD(&pool->lru);
+	spin_lock_init(&pool->lru_lock);
+	pool->compact_after = jiffies;
 
 	zswap_pool_debug("created", pool);
 
@@ -937,6 +970,60 @@ end:
 	return ret;
 }
 
+/* Number of lru entries tried before giving up on writing one back */
+#define ZSWAP_LRU_WRITEBACK_TRIES	8
+
+/*
+ * Write back the least recently stored entries of a pool whose zpool has
+ * no lru of its own to evict from, such as zsmalloc.
+ */
+static int zswap_shrink_lru(struct zswap_pool *pool)
+{
+	struct zswap_entry *entry;
+	struct zswap_tree *tree;
+	unsigned long handle;
+	pgoff_t offset;
+	int ret = -EINVAL, tries;
+
+	for (tries = 0; tries < ZSWAP_LRU_WRITEBACK_TRIES; tries++) {
+		spin_lock(&pool->lru_lock);
+		if (list_empty(&pool->lru)) {
+			spin_unlock(&pool->lru_lock);
+			return -EINVAL;
+		}
+		entry = list_last_entry(&pool->lru, struct zswap_entry, lru);
+		/* move on to the next one if this one can't be written back */
+		list_move(&entry->lru, &pool->lru);
+		tree = zswap_trees[entry->type];
+		offset = entry->offset;
+		spin_unlock(&pool->lru_lock);
+
+		/*
+		 * The entry may have been freed once off the lru lock, only
+		 * use it if it is still the one in the tree.
+		 */
+		spin_lock(&tree->lock);
+		if (entry != zswap_rb_search(&tree->rbroot, offset)) {
+			spin_unlock(&tree->lock);
+			continue;
+		}
+		zswap_entry_get(entry);
+		handle = entry->handle;
+		spin_unlock(&tree->lock);
+
+		ret = zswap_writeback_entry(pool->zpool, handle);
+
+		spin_lock(&tree->lock);
+		zswap_entry_put(tree, entry);
+		spin_unlock(&tree->lock);
+
+		if (!ret)
+			break;
+	}
+
+	return ret;
+}
+
 static int zswap_shrink(void)
 {
 	struct zswap_pool *pool;
@@ -947,12 +1034,57 @@ static int zswap_shrink(void)
 		return -ENOENT;
 
 	ret = zpool_shrink(pool->zpool, 1, NULL);
+	if (ret == -EINVAL)
+		ret = zswap_shrink_lru(pool);
 
 	zswap_pool_put(pool);
 
 	return ret;
 }
 
+/* How long to leave a pool alone once compacting it freed nothing */
+#define ZSWAP_COMPACT_BACKOFF	HZ
+
+/*
+ * Free the pages of the current pool left unused by fragmentation, if
+ * that is a quarter of the pool or more, so that room is made without
+ * writing anything back.  Compacting walks the whole pool, so only one
+ * store does it at a time, and none for a while after a walk that freed
+ * nothing: fragmentation that compaction can't reduce would otherwise
+ * have every store of a full pool walk it again.
+ */
+static void zswap_compact(void)
+{
+	struct zswap_pool *pool;
+	u64 total, stored;
+	unsigned long freed;
+
+	pool = zswap_pool_current_get();
+	if (!pool)
+		return;
+
+	if (time_before(jiffies, READ_ONCE(pool->compact_after)) ||
+	    atomic_xchg(&pool->compacting, 1))
+		goto out;
+
+	total = zpool_get_total_size(pool->zpool);
+	stored = atomic64_read(&pool->stored_size);
+	if (total && total - min(total, stored) >= total / 4) {
+		freed = zpool_compact(pool->zpool);
+		if (freed) {
+			zswap_compacted_pages += freed;
+			zswap_update_total_size();
+		} else {
+			WRITE_ONCE(pool->compact_after,
+				   jiffies + ZSWAP_COMPACT_BACKOFF);
+		}
+	}
+
+	atomic_set(&pool->compacting, 0);
+out:
+	zswap_pool_put(pool);
+}
+
 /*********************************
 * frontswap hooks
 **********************************/
@@ -975,10 +1107,11 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto reject;
 	}
 
-	/* reclaim space if needed */
+	/* reclaim space if needed, compacting before writing anything back */
 	if (zswap_is_full()) {
 		zswap_pool_limit_hit++;
-		if (zswap_shrink()) {
+		zswap_compact();
+		if (zswap_is_full() && zswap_shrink()) {
 			zswap_reject_reclaim_fail++;
 			ret = -ENOMEM;
 			goto reject;
@@ -1034,8 +1167,11 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 
 	/* populate entry */
 	entry->offset = offset;
+	entry->type = type;
 	entry->handle = handle;
 	entry->length = dlen;
+	atomic64_add(len, &entry->pool->stored_size);
+	atomic_inc(&entry->pool->stored_pages);
 
 	/* map */
 	spin_lock(&tree->lock);
@@ -1048,6 +1184,9 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	spin_lock(&entry->pool->lru_lock);
+	list_add(&entry->lru, &entry->pool->lru);
+	spin_unlock(&entry->pool->lru_lock);
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1182,6 +1321,44 @@ static struct frontswap_ops zswap_frontswap_ops = {
 
 static struct dentry *zswap_debugfs_root;
 
+/*
+ * One line per pool: how much of the zpool's memory actually holds
+ * compressed data, the rest being lost to fragmentation.
+ */
+static int zswap_pool_stats_show(struct seq_file *m, void *v)
+{
+	struct zswap_pool *pool;
+	u64 total, stored;
+
+	seq_printf(m, "%-10s %-12s %12s %12s %10s %5s\n", "zpool",
+		   "compressor", "total_size", "stored_size", "pages", "frag");
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(pool, &zswap_pools, list) {
+		total = zpool_get_total_size(pool->zpool);
+		stored = min_t(u64, total, atomic64_read(&pool->stored_size));
+		seq_printf(m, "%-10s %-12s %12llu %12llu %10d %4llu%%\n",
+			   zpool_get_type(pool->zpool), pool->tfm_name,
+			   total, stored, atomic_read(&pool->stored_pages),
+			   total ? div64_u64((total - stored) * 100, total) : 0);
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+
+static int zswap_pool_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zswap_pool_stats_show, NULL);
+}
+
+static const struct file_operations zswap_pool_stats_fops = {
+	.open = zswap_pool_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int __init zswap_debugfs_init(void)
 {
 	if (!debugfs_initialized())
@@ -1203,12 +1380,16 @@ static int __init zswap_debugfs_init(void)
 			zswap_debugfs_root, &zswap_reject_compress_poor);
 	debugfs_create_u64("written_back_pages", S_IRUGO,
 			zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("compacted_pages", S_IRUGO,
+			zswap_debugfs_root, &zswap_compacted_pages);
 	debugfs_create_u64("duplicate_entry", S_IRUGO,
 			zswap_debugfs_root, &zswap_duplicate_entry);
 	debugfs_create_u64("pool_total_size", S_IRUGO,
 			zswap_debugfs_root, &zswap_pool_total_size);
 	debugfs_create_atomic_t("stored_pages", S_IRUGO,
 			zswap_debugfs_root, &zswap_stored_pages);
+	debugfs_create_file("pool_stats", S_IRUGO, zswap_debugfs_root,
+			NULL, &zswap_pool_stats_fops);
 
 	return 0;
 }
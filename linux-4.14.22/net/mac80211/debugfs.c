@@ -15,6 +15,7 @@
 #include "driver-ops.h"
 #include "rate.h"
 #include "debugfs.h"
+#include "tkip.h"
 
 #define DEBUGFS_FORMAT_BUFFER_SIZE 100
 
@@ -293,7 +294,25 @@ static ssize_t queues_read(struct file *file, char __user *user_buf,
 	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
 }
 
+static ssize_t tkip_bench_read(struct file *file, char __user *user_buf,
+			       size_t count, loff_t *ppos)
+{
+	char buf[128];
+	int len;
+
+	/* don't rerun the benchmark for the EOF read */
+	if (*ppos)
+		return 0;
+
+	len = ieee80211_tkip_bench(buf, sizeof(buf));
+	if (len < 0)
+		return len;
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
 DEBUGFS_READONLY_FILE_OPS(hwflags);
+DEBUGFS_READONLY_FILE_OPS(tkip_bench);
 DEBUGFS_READONLY_FILE_OPS(queues);
 DEBUGFS_READONLY_FILE_OPS(misc);
 
@@ -372,6 +391,7 @@ void debugfs_hw_add(struct ieee80211_local *local)
 	DEBUGFS_ADD(hwflags);
 	DEBUGFS_ADD(user_power);
 	DEBUGFS_ADD(power);
+	DEBUGFS_ADD(tkip_bench);
 
 	if (local->ops->wake_tx_queue)
 		DEBUGFS_ADD_MODE(aqm, 0600);
@@ -51,6 +51,9 @@ struct tkip_ctx {
 
 struct tkip_ctx_rx {
 	struct tkip_ctx ctx;
+	struct tkip_ctx spare;	/* previously used phase 1 key */
+	u8 ta[ETH_ALEN];	/* transmitter ctx.p1k was computed for */
+	u8 spare_ta[ETH_ALEN];	/* transmitter spare.p1k was computed for */
 	u32 iv32;	/* current iv32 */
 	u16 iv16;	/* current iv16 */
 };
@@ -11,13 +11,18 @@
 #include <linux/bitops.h>
 #include <linux/types.h>
 #include <linux/netdevice.h>
+#include <linux/etherdevice.h>
 #include <linux/export.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
 #include <asm/unaligned.h>
 
 #include <net/mac80211.h>
 #include "driver-ops.h"
 #include "key.h"
 #include "tkip.h"
+#include "michael.h"
 #include "wep.h"
 
 #define PHASE1_LOOP_COUNT 8
@@ -235,6 +240,37 @@ int ieee80211_tkip_encrypt_data(struct crypto_cipher *tfm,
 					  payload, payload_len);
 }
 
+/*
+ * Make rx_ctx->ctx hold the phase 1 key for @ta/@iv32. The key it replaces
+ * is kept as a spare: a corrupted or forged frame carrying a future IV32 is
+ * dropped after the MIC check, and the next genuine frame then switches
+ * back without redoing phase 1. The lookup is keyed on the IV32 and TA the
+ * cached key was actually derived for, not the last accepted IV32, so such
+ * a frame can no longer leave a stale key behind for the frames after it.
+ */
+static void tkip_rx_p1k(const u8 *tk, struct tkip_ctx_rx *rx_ctx,
+			const u8 *ta, u32 iv32)
+{
+	if (rx_ctx->ctx.state != TKIP_STATE_NOT_INIT &&
+	    rx_ctx->ctx.p1k_iv32 == iv32 && ether_addr_equal(rx_ctx->ta, ta))
+		return;
+
+	if (rx_ctx->spare.state != TKIP_STATE_NOT_INIT &&
+	    rx_ctx->spare.p1k_iv32 == iv32 &&
+	    ether_addr_equal(rx_ctx->spare_ta, ta)) {
+		swap(rx_ctx->ctx, rx_ctx->spare);
+		/* the hardware was last given the other key */
+		rx_ctx->ctx.state = TKIP_STATE_PHASE1_DONE;
+	} else {
+		rx_ctx->spare = rx_ctx->ctx;
+		/* IV16 wrapped around - perform TKIP phase 1 */
+		tkip_mixing_phase1(tk, &rx_ctx->ctx, ta, iv32);
+	}
+
+	memcpy(rx_ctx->spare_ta, rx_ctx->ta, ETH_ALEN);
+	memcpy(rx_ctx->ta, ta, ETH_ALEN);
+}
+
 /* Decrypt packet payload with TKIP using @key. @pos is a pointer to the
  * beginning of the buffer containing IEEE 802.11 header payload, i.e.,
  * including IV, Ext. IV, real data, Michael MIC, ICV. @payload_len is the
@@ -274,14 +310,12 @@ int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
 	if (only_iv) {
 		res = TKIP_DECRYPT_OK;
 		rx_ctx->ctx.state = TKIP_STATE_PHASE1_HW_UPLOADED;
+		/* no software phase 1 key for this IV32 */
+		eth_zero_addr(rx_ctx->ta);
 		goto done;
 	}
 
-	if (rx_ctx->ctx.state == TKIP_STATE_NOT_INIT ||
-	    rx_ctx->iv32 != iv32) {
-		/* IV16 wrapped around - perform TKIP phase 1 */
-		tkip_mixing_phase1(tk, &rx_ctx->ctx, ta, iv32);
-	}
+	tkip_rx_p1k(tk, rx_ctx, ta, iv32);
 	if (key->local->ops->update_tkip_key &&
 	    key->flags & KEY_FLAG_UPLOADED_TO_HARDWARE &&
 	    rx_ctx->ctx.state != TKIP_STATE_PHASE1_HW_UPLOADED) {
@@ -312,3 +346,64 @@ int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
 
 	return res;
 }
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+#define TKIP_BENCH_LOOPS	10000
+#define TKIP_BENCH_LEN		1500
+
+/*
+ * Time the software TKIP key mixing and Michael MIC on a dummy key, to
+ * judge what handing them to the hardware would save. Reports the cost
+ * of each step in ns; Michael is measured over a full-sized MSDU.
+ */
+int ieee80211_tkip_bench(char *buf, size_t len)
+{
+	static const u8 ta[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	u8 tk[16], mic_key[8], rc4key[16], mic[MICHAEL_MIC_LEN];
+	struct ieee80211_hdr hdr = {};
+	struct tkip_ctx ctx;
+	u64 t0, p1, p2, mm;
+	u8 *data;
+	int i;
+
+	data = kzalloc(TKIP_BENCH_LEN, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	get_random_bytes(tk, sizeof(tk));
+	get_random_bytes(mic_key, sizeof(mic_key));
+	hdr.frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA |
+					IEEE80211_STYPE_DATA |
+					IEEE80211_FCTL_FROMDS);
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < TKIP_BENCH_LOOPS; i++) {
+		tkip_mixing_phase1(tk, &ctx, ta, i);
+		barrier_data(&ctx);
+	}
+	p1 = ktime_get_ns() - t0;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < TKIP_BENCH_LOOPS; i++) {
+		tkip_mixing_phase2(tk, &ctx, i, rc4key);
+		barrier_data(rc4key);
+	}
+	p2 = ktime_get_ns() - t0;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < TKIP_BENCH_LOOPS; i++)
+		michael_mic(mic_key, &hdr, data, TKIP_BENCH_LEN, mic);
+	mm = ktime_get_ns() - t0;
+
+	kfree(data);
+
+	return scnprintf(buf, len,
+			 "phase1: %llu ns\nphase2: %llu ns\n"
+			 "michael(%d): %llu ns (%llu MB/s)\n",
+			 div_u64(p1, TKIP_BENCH_LOOPS),
+			 div_u64(p2, TKIP_BENCH_LOOPS),
+			 TKIP_BENCH_LEN, div_u64(mm, TKIP_BENCH_LOOPS),
+			 mm ? div64_u64((u64)TKIP_BENCH_LEN *
+					TKIP_BENCH_LOOPS * 1000, mm) : 0);
+}
+#endif
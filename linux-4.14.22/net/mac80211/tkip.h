@@ -30,4 +30,8 @@ int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
 				u8 *ra, int only_iv, int queue,
 				u32 *out_iv32, u16 *out_iv16);
 
+#ifdef CONFIG_MAC80211_DEBUGFS
+int ieee80211_tkip_bench(char *buf, size_t len);
+#endif
+
 #endif /* TKIP_H */
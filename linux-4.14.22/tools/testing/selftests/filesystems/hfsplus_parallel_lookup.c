@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * hfsplus parallel lookup test-case
+ * Catalog lookups and readdir share the B-tree lock, so several readers can
+ * miss on the same B-tree node and race to read it in.  Fill one directory
+ * with enough entries to span many catalog nodes, then have threads list it
+ * and stat every entry concurrently, each from a different starting point.
+ * The caller is expected to drop the caches first so that the nodes are not
+ * already hashed.  A reference counting bug shows up as an oops, or as
+ * lookups failing with EIO.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#define HFSPLUS_SUPER_MAGIC	0x482b
+
+#define NR_FILES	4096
+#define NR_THREADS	16
+#define NR_LOOPS	8
+
+static char dir[PATH_MAX - 16];
+static int failed;
+
+static void *lookup_thread(void *arg)
+{
+	long id = (long)arg;
+	char path[PATH_MAX];
+	struct dirent *de;
+	struct stat st;
+	int i, loop, n;
+	DIR *d;
+
+	for (loop = 0; loop < NR_LOOPS; loop++) {
+		d = opendir(dir);
+		if (!d) {
+			printf("opendir(%s) failed: %m\n", dir);
+			__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+		n = 0;
+		errno = 0;
+		while ((de = readdir(d)))
+			n++;
+		if (errno) {
+			printf("readdir(%s) failed: %m\n", dir);
+			__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+		}
+		closedir(d);
+
+		/* "." and ".." */
+		if (n != NR_FILES + 2) {
+			printf("readdir(%s) returned %d entries, expected %d\n",
+			       dir, n, NR_FILES + 2);
+			__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+		}
+
+		for (i = 0; i < NR_FILES; i++) {
+			snprintf(path, sizeof(path), "%s/f%05ld",
+				 dir, (i + id * NR_FILES / NR_THREADS) %
+				 NR_FILES);
+			if (stat(path, &st)) {
+				printf("stat(%s) failed: %m\n", path);
+				__atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static int drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		return -1;
+	if (write(fd, "3", 1) != 1) {
+		close(fd);
+		return -1;
+	}
+	return close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t threads[NR_THREADS];
+	char path[PATH_MAX];
+	struct statfs sfs;
+	long i;
+	int fd;
+
+	if (argc != 2) {
+		printf("usage: %s <directory on an hfsplus mount>\n", argv[0]);
+		return 1;
+	}
+
+	if (statfs(argv[1], &sfs)) {
+		printf("statfs(%s) failed: %m\n", argv[1]);
+		return 1;
+	}
+	if (sfs.f_type != HFSPLUS_SUPER_MAGIC) {
+		printf("%s is not on hfsplus\n", argv[1]);
+		return 1;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/parallel_lookup", argv[1]);
+	if (mkdir(dir, 0755)) {
+		printf("mkdir(%s) failed: %m\n", dir);
+		return 1;
+	}
+
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/f%05ld", dir, i);
+		fd = open(path, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0) {
+			printf("open(%s) failed: %m\n", path);
+			return 1;
+		}
+		close(fd);
+	}
+
+	if (drop_caches())
+		printf("dropping caches failed, nodes may be cached: %m\n");
+
+	for (i = 0; i < NR_THREADS; i++) {
+		errno = pthread_create(&threads[i], NULL, lookup_thread,
+				       (void *)i);
+		if (errno) {
+			printf("pthread_create failed: %m\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < NR_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/f%05ld", dir, i);
+		unlink(path);
+	}
+	rmdir(dir);
+
+	if (failed) {
+		printf("hfsplus parallel lookup: [FAIL]\n");
+		return 1;
+	}
+	printf("hfsplus parallel lookup: [PASS]\n");
+	return 0;
+}
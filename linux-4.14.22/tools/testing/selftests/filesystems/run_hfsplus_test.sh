@@ -0,0 +1,35 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+# Run hfsplus_parallel_lookup on a freshly made hfsplus image.
+
+IMG=./hfsplus.img
+MNT=./hfsplus_mnt
+
+if ! which mkfs.hfsplus > /dev/null 2>&1; then
+	echo "hfsplus parallel lookup: mkfs.hfsplus not found [SKIP]"
+	exit 0
+fi
+if [ "$(id -u)" -ne 0 ]; then
+	echo "hfsplus parallel lookup: must be run as root [SKIP]"
+	exit 0
+fi
+
+cleanup()
+{
+	umount $MNT 2>/dev/null
+	rmdir $MNT 2>/dev/null
+	rm -f $IMG
+}
+trap cleanup EXIT
+
+set -e
+
+dd if=/dev/zero of=$IMG bs=1M count=64 2>/dev/null
+mkfs.hfsplus $IMG > /dev/null
+mkdir -p $MNT
+if ! mount -t hfsplus -o loop $IMG $MNT; then
+	echo "hfsplus parallel lookup: cannot mount hfsplus [SKIP]"
+	exit 0
+fi
+
+./hfsplus_parallel_lookup $MNT